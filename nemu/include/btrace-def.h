@@ -0,0 +1,74 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __BTRACE_DEF_H__
+#define __BTRACE_DEF_H__
+
+#include <stdint.h>
+
+/* A binary trace file starts with a BTraceHeader, followed by a stream
+ * of records. Each record begins with a tag byte:
+ *
+ * - instruction: (BTRACE_TAG_INST | ilen), the zigzag varint of
+ *   (pc - expected pc), then ilen raw instruction bytes in memory order.
+ *   The expected pc is (pc + ilen) of the previous instruction record,
+ *   so sequential execution costs a single byte for the pc.
+ *
+ * - memory access: (BTRACE_TAG_MEM | is_write << 3 | log2(len)), the
+ *   zigzag varint of (addr - addr of the previous memory record), then
+ *   len bytes of data in little endian. Memory records are emitted while
+ *   the instruction executes, so they come before its instruction record.
+ *
+ * Both expected pc and previous address start from 0.
+ */
+
+#define BTRACE_MAGIC   "NEMUBTR"
+#define BTRACE_VERSION 1
+
+typedef struct {
+  char magic[8];     // BTRACE_MAGIC
+  char isa[16];      // e.g. "riscv32", "x86"
+  uint32_t version;  // BTRACE_VERSION
+  uint32_t word_size;// sizeof(word_t) of the guest
+} BTraceHeader;
+
+#define BTRACE_TAG_MASK  0xf0
+#define BTRACE_TAG_INST  0x10
+#define BTRACE_TAG_MEM   0x20
+#define BTRACE_MEM_WRITE 0x08
+
+#define BTRACE_REC_MAX (1 + 10 + 16) // tag + varint + payload
+
+static inline uint8_t *btrace_put_varint(uint8_t *p, int64_t v) {
+  uint64_t z = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+  while (z >= 0x80) { *p ++ = (z & 0x7f) | 0x80; z >>= 7; }
+  *p ++ = z;
+  return p;
+}
+
+static inline const uint8_t *btrace_get_varint(const uint8_t *p, const uint8_t *end, int64_t *v) {
+  uint64_t z = 0;
+  int shift = 0;
+  while (p < end && shift < 64) {
+    uint8_t b = *p ++;
+    z |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) { *v = (int64_t)(z >> 1) ^ -(int64_t)(z & 1); return p; }
+    shift += 7;
+  }
+  return NULL; // truncated or malformed
+}
+
+#endif
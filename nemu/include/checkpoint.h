@@ -0,0 +1,44 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <common.h>
+
+// Register a piece of machine state to be saved into checkpoints.
+// `save' is called before it is saved and `load' after it is restored,
+// either may be NULL.
+void ckpt_add(const char *name, void *addr, size_t size, void (*save)(), void (*load)());
+
+// save in a forked child if `background' is true
+bool ckpt_save(const char *file, bool background);
+bool ckpt_load(const char *file);
+
+// copy the registered state except pmem from or to `buf' in memory,
+// for the snapshots of reverse execution
+size_t ckpt_state_size();
+void ckpt_state_save(uint8_t *buf);
+void ckpt_state_load(const uint8_t *buf);
+// copy the whole machine to the DiffTest REF after it is restored
+void ckpt_sync_ref();
+
+// return whether the machine is restored from `load_file'
+bool init_ckpt(const char *load_file, const char *save_file);
+// save the checkpoint given by --save, and wait for the background saves
+void ckpt_finish();
+
+#endif
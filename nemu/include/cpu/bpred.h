@@ -0,0 +1,32 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_BPRED_H__
+#define __CPU_BPRED_H__
+
+#include <cpu/decode.h>
+
+#ifdef CONFIG_BPRED
+bool bpred_step(Decode *s, int cls);
+void bpred_statistic();
+void bpred_dump_json(FILE *fp);
+void bpred_add_ckpt();
+#else
+static inline bool bpred_step(Decode *s, int cls) { return false; }
+static inline void bpred_statistic() {}
+#endif
+
+#endif
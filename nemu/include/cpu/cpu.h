@@ -19,9 +19,11 @@
 #include <common.h>
 
 void cpu_exec(uint64_t n);
+void cpu_exec_ref(uint64_t n);
 
 void set_nemu_state(int state, vaddr_t pc, int halt_ret);
 void invalid_inst(vaddr_t thispc);
+void cpu_wfi();
 
 #define NEMUTRAP(thispc, code) set_nemu_state(NEMU_END, thispc, code)
 #define INV(thispc) invalid_inst(thispc)
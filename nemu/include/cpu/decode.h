@@ -17,6 +17,7 @@
 #define __CPU_DECODE_H__
 
 #include <isa.h>
+#include <cpu/reverse.h>
 
 typedef struct Decode {
   vaddr_t pc;
@@ -86,11 +87,32 @@ finish:
 }
 
 
+// --- per-pattern counters ---
+#ifdef CONFIG_PERF
+typedef struct {
+  const char *pattern;
+  const char *name;
+  uint64_t cnt;
+} PerfInstpat;
+
+// pointers to the counters of all patterns are collected in a linker
+// section, they have the same size so the section can be walked as an array
+#define __INSTPAT_NAME(name, ...) #name
+#define INSTPAT_PERF(pat, ...) do { \
+  static PerfInstpat __perf = { .pattern = pat, .name = __INSTPAT_NAME(__VA_ARGS__) }; \
+  static PerfInstpat *__perf_p __attribute__((section("perf_instpat"), used)) = &__perf; \
+  if (rev_live()) __perf.cnt ++; \
+} while (0)
+#else
+#define INSTPAT_PERF(pattern, ...)
+#endif
+
 // --- pattern matching wrappers for decode ---
 #define INSTPAT(pattern, ...) do { \
   uint64_t key, mask, shift; \
   pattern_decode(pattern, STRLEN(pattern), &key, &mask, &shift); \
   if ((((uint64_t)INSTPAT_INST(s) >> shift) & mask) == key) { \
+    INSTPAT_PERF(pattern, ##__VA_ARGS__); \
     INSTPAT_MATCH(s, ##__VA_ARGS__); \
     goto *(__instpat_end); \
   } \
@@ -35,10 +35,45 @@ static inline void difftest_detach() {}
 static inline void difftest_attach() {}
 #endif
 
+#ifdef CONFIG_DIFFTEST_ASYNC
+void difftest_async_init();
+void difftest_async_step(vaddr_t pc, bool sync);
+void difftest_async_store(paddr_t addr, int len, word_t data);
+// wait for REF to catch up, before REF is called directly
+void difftest_async_drain();
+// DUT is calling REF directly, its stores are not committed to REF
+extern bool difftest_async_direct;
+#endif
+
+#ifdef CONFIG_DIFFTEST
+// pages of pmem written since the last check
+extern uint64_t difftest_dirty[];
+void difftest_dirty_page(paddr_t pg);
+
+// called before pmem is written, to record the pages written first after
+// the last check, and keep their old content in batch mode. The stores
+// are committed to REF in asynchronous mode instead.
+static inline void difftest_note_write(paddr_t addr, int len, word_t data) {
+#ifdef CONFIG_DIFFTEST_ASYNC
+  difftest_async_store(addr, len, data);
+#else
+  paddr_t hi = (addr + len - 1 - CONFIG_MBASE) / 4096;
+  for (paddr_t pg = (addr - CONFIG_MBASE) / 4096; pg <= hi; pg ++) {
+    if (unlikely(!(difftest_dirty[pg / 64] & (1ull << (pg % 64))))) difftest_dirty_page(pg);
+  }
+#endif
+}
+#endif
+
+#ifdef CONFIG_DIFFTEST_BATCH
+void difftest_batch_reset();
+#endif
+
 extern void (*ref_difftest_memcpy)(paddr_t addr, void *buf, size_t n, bool direction);
 extern void (*ref_difftest_regcpy)(void *dut, bool direction);
 extern void (*ref_difftest_exec)(uint64_t n);
 extern void (*ref_difftest_raise_intr)(uint64_t NO);
+extern uint64_t (*ref_difftest_memhash)(paddr_t addr, size_t n);
 
 static inline bool difftest_check_reg(const char *name, vaddr_t pc, word_t ref, word_t dut) {
   if (ref != dut) {
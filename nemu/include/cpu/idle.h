@@ -0,0 +1,54 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_IDLE_H__
+#define __CPU_IDLE_H__
+
+#include <common.h>
+
+#ifdef CONFIG_IDLE_DETECT
+extern uint64_t g_nr_guest_inst;
+extern uint64_t g_idle_nr_poll;
+extern uint64_t g_idle_nr_mmio_write;
+
+// called by devices when the guest reads a register which only tells it
+// to wait, e.g. the RTC or an empty status register
+static inline void idle_note_poll() { g_idle_nr_poll ++; }
+static inline void idle_note_mmio_write() { g_idle_nr_mmio_write ++; }
+
+void idle_spin_detected();
+
+// A guest is considered spinning if it keeps polling devices within a
+// short window of instructions without driving any device.
+#define IDLE_WINDOW 4096
+#define IDLE_NR_POLL 8
+
+static inline void idle_check() {
+  static uint64_t win_start = 0, win_poll = 0, win_write = 0;
+  if (likely(g_nr_guest_inst - win_start < IDLE_WINDOW)) return;
+  bool spinning = (g_idle_nr_poll - win_poll >= IDLE_NR_POLL) &&
+    (g_idle_nr_mmio_write == win_write);
+  win_start = g_nr_guest_inst;
+  win_poll = g_idle_nr_poll;
+  win_write = g_idle_nr_mmio_write;
+  if (spinning) idle_spin_detected();
+}
+#else
+static inline void idle_note_poll() {}
+static inline void idle_note_mmio_write() {}
+static inline void idle_check() {}
+#endif
+
+#endif
@@ -0,0 +1,48 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __CPU_IQUEUE_H__
+#define __CPU_IQUEUE_H__
+
+#include <common.h>
+
+#define IQUEUE_ILEN_MAX MUXDEF(CONFIG_ISA_x86, 16, 4)
+
+typedef struct {
+  vaddr_t pc;
+  uint8_t ilen;
+  uint8_t inst[IQUEUE_ILEN_MAX];
+} IQueueEntry;
+
+#ifdef CONFIG_IQUEUE
+extern IQueueEntry iqueue[CONFIG_IQUEUE_SIZE];
+extern int iqueue_idx;
+
+// only record the raw instruction here, it is disassembled when dumped
+static inline void iqueue_push(vaddr_t pc, const void *inst, int ilen) {
+  IQueueEntry *e = &iqueue[iqueue_idx];
+  e->pc = pc;
+  e->ilen = ilen;
+  memcpy(e->inst, inst, IQUEUE_ILEN_MAX);
+  iqueue_idx = (iqueue_idx + 1 == CONFIG_IQUEUE_SIZE ? 0 : iqueue_idx + 1);
+}
+
+void iqueue_dump();
+#else
+static inline void iqueue_push(vaddr_t pc, const void *inst, int ilen) {}
+static inline void iqueue_dump() {}
+#endif
+
+#endif
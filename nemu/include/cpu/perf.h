@@ -0,0 +1,44 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_PERF_H__
+#define __CPU_PERF_H__
+
+#include <cpu/decode.h>
+#include <cpu/reverse.h>
+
+#ifdef CONFIG_PERF
+typedef struct {
+  uint64_t nr_load, nr_store;
+  uint64_t nr_branch_taken, nr_branch_not_taken;
+  uint64_t nr_trap;
+  uint64_t nr_class[NR_INST_CLASS];
+} PerfStat;
+
+extern PerfStat g_perf;
+
+void perf_step(Decode *s, int cls);
+void perf_display();
+void perf_report();
+#else
+static inline void perf_step(Decode *s, int cls) {}
+static inline void perf_display() {}
+static inline void perf_report() {}
+#endif
+
+#define perf_count(x) IFDEF(CONFIG_PERF, do { if (rev_live()) g_perf.x ++; } while (0))
+
+#endif
@@ -0,0 +1,51 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_REVERSE_H__
+#define __CPU_REVERSE_H__
+
+#include <common.h>
+
+#ifdef CONFIG_REVERSE
+extern uint64_t g_nr_guest_inst;
+// pages of pmem written since the latest snapshot
+extern uint64_t rev_dirty[];
+// whether the guest is re-executing the recorded history
+extern bool rev_replaying;
+// the instruction count when rev_event() should be called
+extern uint64_t rev_next_event;
+
+void rev_save_page(paddr_t pg);
+void rev_event();
+word_t rev_replay_read();
+void rev_record_read(word_t data);
+void rev_reset();
+
+// called before pmem is written, to keep the old content of the pages
+// written first in this interval
+static inline void rev_note_write(paddr_t addr, int len) {
+  paddr_t hi = (addr + len - 1 - CONFIG_MBASE) / 4096;
+  for (paddr_t pg = (addr - CONFIG_MBASE) / 4096; pg <= hi; pg ++) {
+    if (unlikely(!(rev_dirty[pg / 64] & (1ull << (pg % 64))))) rev_save_page(pg);
+  }
+}
+#endif
+
+// the profilers only count the instructions executed for the first time,
+// while the models are part of the snapshots and run again when replaying
+#define rev_live() MUXDEF(CONFIG_REVERSE, !rev_replaying, true)
+
+#endif
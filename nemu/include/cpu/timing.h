@@ -0,0 +1,57 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __CPU_TIMING_H__
+#define __CPU_TIMING_H__
+
+#include <cpu/decode.h>
+
+extern uint64_t g_nr_guest_inst;
+
+// where the cycles are spent
+enum { TIMING_INST, TIMING_CACHE, TIMING_BPRED, TIMING_DEVICE, NR_TIMING_SRC };
+
+#ifdef CONFIG_TIMING
+extern uint64_t g_cycle;
+extern uint64_t g_timing_cycle[NR_TIMING_SRC];
+extern bool g_timing_on;
+
+static inline void timing_add(int src, uint32_t cycle) {
+  if (g_timing_on) {
+    g_cycle += cycle;
+    g_timing_cycle[src] += cycle;
+  }
+}
+
+void timing_step(Decode *s, int cls, bool mispredict);
+void timing_set(bool on);
+void timing_display();
+void timing_statistic();
+void timing_dump_json(FILE *fp);
+void timing_add_ckpt();
+#else
+static inline void timing_add(int src, uint32_t cycle) {}
+static inline void timing_step(Decode *s, int cls, bool mispredict) {}
+static inline void timing_statistic() {}
+#endif
+
+// the value of the cycle counter seen by the guest,
+// every instruction takes one cycle without the timing model
+static inline uint64_t get_cycle() {
+  return MUXDEF(CONFIG_TIMING, g_cycle, g_nr_guest_inst);
+}
+
+#endif
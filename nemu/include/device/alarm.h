@@ -20,5 +20,6 @@
 
 typedef void (*alarm_handler_t) ();
 void add_alarm_handle(alarm_handler_t h);
+void alarm_trigger();
 
 #endif
@@ -0,0 +1,49 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#ifndef __DEVICE_INTR_H__
+#define __DEVICE_INTR_H__
+
+#include <common.h>
+
+// interrupt sources wired into the PLIC, 0 is reserved by the PLIC spec
+enum {
+  IRQ_NONE,
+  IRQ_SERIAL,    // serial RX FIFO is not empty
+  IRQ_KEYBOARD,  // keyboard queue is not empty
+  IRQ_SDCARD,    // block transfer is finished
+  NR_IRQ
+};
+
+void dev_raise_intr();
+void dev_set_ext_intr(bool level);
+bool dev_intr_pending();
+bool dev_ext_intr_pending();
+void dev_ack_intr();
+
+#ifdef CONFIG_HAS_PLIC
+void plic_raise_irq(int irq);
+void plic_lower_irq(int irq);
+#else
+static inline void plic_raise_irq(int irq) {}
+static inline void plic_lower_irq(int irq) {}
+#endif
+
+static inline void plic_set_irq(int irq, bool level) {
+  if (level) plic_raise_irq(irq);
+  else plic_lower_irq(irq);
+}
+
+#endif
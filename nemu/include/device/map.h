@@ -28,6 +28,12 @@ typedef struct {
   paddr_t high;
   void *space;
   io_callback_t callback;
+#ifdef CONFIG_PERF
+  uint64_t nr_read, nr_write;
+#endif
+#ifdef CONFIG_TIMING
+  uint32_t lat_read, lat_write;
+#endif
 } IOMap;
 
 static inline bool map_inside(IOMap *map, paddr_t addr) {
@@ -50,6 +56,13 @@ void add_pio_map(const char *name, ioaddr_t addr,
 void add_mmio_map(const char *name, paddr_t addr,
         void *space, uint32_t len, io_callback_t callback);
 
+#ifdef CONFIG_PERF
+void perf_add_map(IOMap *map);
+#endif
+#ifdef CONFIG_TIMING
+void timing_add_map(IOMap *map);
+#endif
+
 word_t map_read(paddr_t addr, int len, IOMap *map);
 void map_write(paddr_t addr, int len, word_t data, IOMap *map);
 
@@ -17,6 +17,7 @@
 #define __DIFFTEST_DEF_H__
 
 #include <stdint.h>
+#include <string.h>
 #include <macro.h>
 #include <generated/autoconf.h>
 
@@ -37,4 +38,26 @@ enum { DIFFTEST_TO_DUT, DIFFTEST_TO_REF };
 # error Unsupport ISA
 #endif
 
+// The hash of memory returned by `difftest_memhash' of REF, which is
+// optional. The 8 lanes are independent, so that the compiler can
+// vectorize the loop. Each step of a lane is a bijection, so a single
+// different word always leads to a different lane.
+static inline uint64_t difftest_hash(const void *buf, size_t n) {
+  const uint8_t *p = (const uint8_t *)buf;
+  uint32_t h[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+  size_t i = 0;
+  for (; i + sizeof(h) <= n; i += sizeof(h)) {
+    for (int k = 0; k < 8; k ++) {
+      uint32_t w;
+      memcpy(&w, p + i + k * 4, 4);
+      h[k] = (h[k] ^ w) * 0x85ebca6bu;
+      h[k] ^= h[k] >> 15;
+    }
+  }
+  uint64_t ret = n;
+  for (int k = 0; k < 8; k ++) ret = (ret ^ h[k]) * 0x100000001b3ull;
+  for (; i < n; i ++) ret = (ret ^ p[i]) * 0x100000001b3ull;
+  return ret ^ (ret >> 29);
+}
+
 #endif
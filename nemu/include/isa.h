@@ -32,11 +32,24 @@ void init_isa();
 extern CPU_state cpu;
 void isa_reg_display();
 word_t isa_reg_str2val(const char *name, bool *success);
+// return where the register is stored, or NULL if it is not a whole word
+word_t* isa_reg_str2ptr(const char *name);
 
 // exec
 struct Decode;
 int isa_exec_once(struct Decode *s);
 
+// classify an executed instruction for tracers and profilers
+enum {
+  INST_OTHER, INST_CALL, INST_RET, INST_JUMP, INST_BRANCH,
+  INST_LOAD, INST_STORE, INST_MULDIV, INST_SYSTEM, NR_INST_CLASS
+};
+int isa_inst_class(struct Decode *s);
+// the users of isa_inst_class(), which need the whole instruction decoded
+#if defined(CONFIG_FTRACE) || defined(CONFIG_PERF) || defined(CONFIG_BPRED) || defined(CONFIG_TIMING)
+#define INST_CLASS_ENABLE
+#endif
+
 // memory
 enum { MMU_DIRECT, MMU_TRANSLATE, MMU_FAIL };
 enum { MEM_TYPE_IFETCH, MEM_TYPE_READ, MEM_TYPE_WRITE };
@@ -0,0 +1,40 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#ifndef __MEMORY_CACHE_H__
+#define __MEMORY_CACHE_H__
+
+#include <common.h>
+
+/* The cache simulator only keeps tags, data are always in pmem.
+ * An access returns the cycles spent on cache misses. */
+
+#ifdef CONFIG_CACHE_SIM
+void init_cache();
+uint32_t cache_ifetch(paddr_t addr, int len);
+uint32_t cache_read(paddr_t addr, int len);
+uint32_t cache_write(paddr_t addr, int len);
+void cache_statistic();
+void cache_dump_json(FILE *fp);
+void cache_add_ckpt();
+#else
+static inline uint32_t cache_ifetch(paddr_t addr, int len) { return 0; }
+static inline uint32_t cache_read(paddr_t addr, int len) { return 0; }
+static inline uint32_t cache_write(paddr_t addr, int len) { return 0; }
+static inline void cache_statistic() {}
+#endif
+
+#endif
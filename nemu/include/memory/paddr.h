@@ -26,12 +26,51 @@
 uint8_t* guest_to_host(paddr_t paddr);
 /* convert the host virtual address in NEMU to guest physical address in the guest program */
 paddr_t host_to_guest(uint8_t *haddr);
+#ifdef CONFIG_TARGET_SHARE
+/* map the memory in file `fd' as pmem, whose pages are copied on write */
+void pmem_map(int fd);
+#endif
 
 static inline bool in_pmem(paddr_t addr) {
   return addr - CONFIG_MBASE < CONFIG_MSIZE;
 }
 
+#ifdef CONFIG_CHECKPOINT
+// pages of pmem written since a checkpoint is restored, one bit per page
+#define PMEM_DIRTY_WORDS ((CONFIG_MSIZE / 4096 + 63) / 64)
+extern uint64_t pmem_dirty[];
+static inline void pmem_mark_dirty(paddr_t addr, int len) {
+  paddr_t hi = (addr + len - 1 - CONFIG_MBASE) / 4096;
+  for (paddr_t pg = (addr - CONFIG_MBASE) / 4096; pg <= hi; pg ++) {
+    pmem_dirty[pg / 64] |= 1ull << (pg % 64);
+  }
+}
+#endif
+
 word_t paddr_read(paddr_t addr, int len);
 void paddr_write(paddr_t addr, int len, word_t data);
+word_t paddr_ifetch(paddr_t addr, int len);
+
+#ifdef CONFIG_MTRACE
+#define MTRACE(addr, len, data, is_write) do { \
+  extern bool mtrace_on; \
+  void mtrace_access(paddr_t, int, word_t, bool); \
+  if (unlikely(mtrace_on)) mtrace_access(addr, len, data, is_write); \
+} while (0)
+#else
+#define MTRACE(addr, len, data, is_write)
+#endif
+
+// check the data watchpoints set by `wm' in sdb before a write,
+// `old' is only evaluated when some watchpoint exists
+#ifndef CONFIG_TARGET_AM
+#define DATA_WATCH(addr, len, old, data) do { \
+  extern int nr_data_wp; \
+  void check_data_wp(paddr_t, int, word_t, word_t); \
+  if (unlikely(nr_data_wp != 0)) check_data_wp(addr, len, old, data); \
+} while (0)
+#else
+#define DATA_WATCH(addr, len, old, data)
+#endif
 
 #endif
@@ -33,6 +33,8 @@ extern NEMUState nemu_state;
 // ----------- timer -----------
 
 uint64_t get_time();
+// make get_time() return `us' now, used to restore a checkpoint
+void set_time(uint64_t us);
 
 // ----------- log -----------
 
@@ -73,5 +75,49 @@ uint64_t get_time();
     log_write(__VA_ARGS__); \
   } while (0)
 
+// ----------- symbol -----------
+
+// functions in the symbol table of the ELF file given by --elf
+typedef struct {
+  vaddr_t addr;
+  word_t size;
+  char *name;
+} Symbol;
+
+extern Symbol *symbol; // sorted by addr
+extern int nr_symbol;
+int symbol_find(vaddr_t addr);
+
+// ----------- interval set -----------
+
+// a set of half-open intervals [lo, hi), which may overlap each other
+typedef struct {
+  uint64_t lo, hi;
+  void *data;
+} Interval;
+
+typedef struct {
+  Interval *iv;     // sorted by lo
+  uint64_t *max_hi; // max_hi[i] = max(iv[0..i].hi)
+  int n, cap;
+} IntervalSet;
+
+void intvl_add(IntervalSet *s, uint64_t lo, uint64_t hi, void *data);
+bool intvl_del(IntervalSet *s, uint64_t lo, uint64_t hi, void *data);
+Interval* intvl_find(IntervalSet *s, uint64_t lo, uint64_t hi);
+Interval* intvl_find_next(IntervalSet *s, uint64_t lo, uint64_t hi, Interval *prev);
+
+// ----------- btrace -----------
+
+#ifdef CONFIG_BTRACE
+#define btrace_enable() ({ \
+  extern bool btrace_on; \
+  extern bool log_enable(); \
+  btrace_on && log_enable(); \
+})
+void btrace_inst(vaddr_t pc, const uint8_t *inst, int ilen);
+void btrace_mem(paddr_t addr, int len, word_t data, bool is_write);
+void btrace_flush();
+#endif
 
 #endif
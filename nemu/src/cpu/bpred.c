@@ -0,0 +1,197 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <cpu/bpred.h>
+#include <checkpoint.h>
+#include <cpu/reverse.h>
+
+#ifdef CONFIG_BPRED
+
+/* All tables are small arrays of bytes or words, so that they stay in the
+ * host cache: 2^12 counters take 4KB, and 2^9 BTB entries take 4KB on
+ * 32-bit guests. */
+
+#define PC_SHIFT MUXDEF(CONFIG_ISA_x86, 0, 2)
+#define PHT_SIZE (1 << CONFIG_BPRED_PHT_BITS)
+#define BTB_SIZE (1 << CONFIG_BPRED_BTB_BITS)
+#define RAS_SIZE CONFIG_BPRED_RAS_SIZE
+
+typedef struct {
+  vaddr_t pc, target;
+} BTBEntry;
+
+static uint8_t pht[PHT_SIZE]; // 2-bit saturating counters
+static uint32_t ghr = 0;      // global history
+static BTBEntry btb[BTB_SIZE];
+static vaddr_t ras[RAS_SIZE];
+static int ras_top = 0;
+
+static const char *class_name[NR_INST_CLASS] = {
+  [INST_CALL] = "call", [INST_RET] = "ret", [INST_JUMP] = "jump", [INST_BRANCH] = "branch",
+};
+static uint64_t nr_exec[NR_INST_CLASS], nr_miss[NR_INST_CLASS];
+
+// mispredicted pcs, open addressing
+typedef struct {
+  vaddr_t pc;
+  uint64_t nr_miss;
+} Hotspot;
+
+static Hotspot *hot = NULL;
+static uint32_t hot_size = 0, nr_hot = 0;
+
+static void hot_insert(Hotspot *tab, uint32_t size, vaddr_t pc, uint64_t n) {
+  uint32_t i = (pc >> PC_SHIFT) & (size - 1);
+  while (tab[i].nr_miss != 0 && tab[i].pc != pc) i = (i + 1) & (size - 1);
+  if (tab[i].nr_miss == 0) { tab[i].pc = pc; nr_hot ++; }
+  tab[i].nr_miss += n;
+}
+
+static void hot_record(vaddr_t pc) {
+  if (nr_hot * 2 >= hot_size) {
+    uint32_t size = (hot_size == 0 ? 1024 : hot_size * 2);
+    Hotspot *tab = calloc(size, sizeof(Hotspot));
+    assert(tab);
+    nr_hot = 0;
+    for (uint32_t i = 0; i < hot_size; i ++) {
+      if (hot[i].nr_miss != 0) hot_insert(tab, size, hot[i].pc, hot[i].nr_miss);
+    }
+    free(hot);
+    hot = tab;
+    hot_size = size;
+  }
+  hot_insert(hot, hot_size, pc, 1);
+}
+
+static inline uint32_t pht_idx(vaddr_t pc) {
+  uint32_t idx = pc >> PC_SHIFT;
+  IFDEF(CONFIG_BPRED_GSHARE, idx ^= ghr);
+  return idx & (PHT_SIZE - 1);
+}
+
+static inline BTBEntry *btb_entry(vaddr_t pc) {
+  return &btb[(pc >> PC_SHIFT) & (BTB_SIZE - 1)];
+}
+
+// return the target predicted by the BTB, or the next pc if it misses
+static inline vaddr_t btb_predict(Decode *s) {
+  BTBEntry *e = btb_entry(s->pc);
+  return (e->pc == s->pc ? e->target : s->snpc);
+}
+
+static inline void btb_update(Decode *s) {
+  BTBEntry *e = btb_entry(s->pc);
+  e->pc = s->pc;
+  e->target = s->dnpc;
+}
+
+// return whether the instruction is mispredicted
+bool bpred_step(Decode *s, int cls) {
+  if (likely(cls != INST_BRANCH && cls != INST_JUMP && cls != INST_CALL && cls != INST_RET)) return false;
+
+  vaddr_t pred;
+  if (cls == INST_BRANCH) {
+    uint8_t *c = &pht[pht_idx(s->pc)];
+    bool taken = (s->dnpc != s->snpc);
+    pred = (*c >= 2 ? btb_predict(s) : s->snpc);
+    if (taken && *c < 3) (*c) ++;
+    if (!taken && *c > 0) (*c) --;
+    ghr = (ghr << 1) | taken;
+    if (taken) btb_update(s);
+  } else if (cls == INST_RET) {
+    ras_top = (ras_top + RAS_SIZE - 1) % RAS_SIZE;
+    pred = ras[ras_top];
+  } else {
+    pred = btb_predict(s);
+    btb_update(s);
+    if (cls == INST_CALL) {
+      ras[ras_top] = s->snpc;
+      ras_top = (ras_top + 1) % RAS_SIZE;
+    }
+  }
+
+  nr_exec[cls] ++;
+  if (pred != s->dnpc) {
+    nr_miss[cls] ++;
+    if (rev_live()) hot_record(s->pc);
+    return true;
+  }
+  return false;
+}
+
+#ifdef CONFIG_CHECKPOINT
+// the hotspots are a profile of this run only, which are not saved
+void bpred_add_ckpt() {
+  ckpt_add("bpred pht", pht, sizeof(pht), NULL, NULL);
+  ckpt_add("bpred ghr", &ghr, sizeof(ghr), NULL, NULL);
+  ckpt_add("bpred btb", btb, sizeof(btb), NULL, NULL);
+  ckpt_add("bpred ras", ras, sizeof(ras), NULL, NULL);
+  ckpt_add("bpred ras top", &ras_top, sizeof(ras_top), NULL, NULL);
+  ckpt_add("bpred exec", nr_exec, sizeof(nr_exec), NULL, NULL);
+  ckpt_add("bpred miss", nr_miss, sizeof(nr_miss), NULL, NULL);
+}
+#endif
+
+static int hot_cmp(const void *a, const void *b) {
+  const Hotspot *x = a, *y = b;
+  return (y->nr_miss > x->nr_miss) - (y->nr_miss < x->nr_miss);
+}
+
+#define NR_HOTSPOT 10
+
+// return the hotspots sorted by mispredictions, the caller should free it
+static Hotspot* sorted_hotspot() {
+  Hotspot *h = malloc(sizeof(Hotspot) * (nr_hot + 1));
+  assert(h);
+  int n = 0;
+  for (uint32_t i = 0; i < hot_size; i ++) {
+    if (hot[i].nr_miss != 0) h[n ++] = hot[i];
+  }
+  qsort(h, n, sizeof(Hotspot), hot_cmp);
+  return h;
+}
+
+void bpred_statistic() {
+  int cls[] = { INST_BRANCH, INST_JUMP, INST_CALL, INST_RET };
+  for (int i = 0; i < ARRLEN(cls); i ++) {
+    int c = cls[i];
+    Log("bpred: %-6s %" PRIu64 " executed, %" PRIu64 " mispredicted (%.2f%%)", class_name[c],
+        nr_exec[c], nr_miss[c], (nr_exec[c] == 0 ? 0 : 100.0 * nr_miss[c] / nr_exec[c]));
+  }
+  Hotspot *h = sorted_hotspot();
+  for (int i = 0; i < NR_HOTSPOT && i < nr_hot; i ++) {
+    Log("bpred: hotspot pc = " FMT_WORD ", %" PRIu64 " mispredictions", h[i].pc, h[i].nr_miss);
+  }
+  free(h);
+}
+
+void bpred_dump_json(FILE *fp) {
+  fprintf(fp, "  \"bpred\": {\n");
+  int cls[] = { INST_BRANCH, INST_JUMP, INST_CALL, INST_RET };
+  for (int i = 0; i < ARRLEN(cls); i ++) {
+    int c = cls[i];
+    fprintf(fp, "    \"%s\": {\"exec\": %" PRIu64 ", \"miss\": %" PRIu64 "},\n", class_name[c], nr_exec[c], nr_miss[c]);
+  }
+  fprintf(fp, "    \"hotspot\": [");
+  Hotspot *h = sorted_hotspot();
+  for (int i = 0; i < NR_HOTSPOT && i < nr_hot; i ++) {
+    fprintf(fp, "%s{\"pc\": %" PRIu64 ", \"miss\": %" PRIu64 "}", (i == 0 ? "" : ", "), (uint64_t)h[i].pc, h[i].nr_miss);
+  }
+  free(h);
+  fprintf(fp, "]\n  }");
+}
+
+#endif
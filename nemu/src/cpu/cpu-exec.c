@@ -16,6 +16,14 @@
 #include <cpu/cpu.h>
 #include <cpu/decode.h>
 #include <cpu/difftest.h>
+#include <cpu/idle.h>
+#include <cpu/iqueue.h>
+#include <cpu/ftrace.h>
+#include <cpu/perf.h>
+#include <cpu/bpred.h>
+#include <cpu/timing.h>
+#include <cpu/reverse.h>
+#include <memory/cache.h>
 #include <locale.h>
 
 /* The assembly code of instructions executed is only output to the screen
@@ -27,16 +35,40 @@
 
 CPU_state cpu = {};
 uint64_t g_nr_guest_inst = 0;
-static uint64_t g_timer = 0; // unit: us
+uint64_t g_timer = 0; // unit: us
 static bool g_print_step = false;
 
 void device_update();
 bool scan_watchpoint();
+extern int nr_breakpoint;
+bool check_breakpoint(vaddr_t pc);
 static void trace_and_difftest(Decode *_this, vaddr_t dnpc) {
-#ifdef CONFIG_ITRACE_COND
-  if (ITRACE_COND) { log_write("%s\n", _this->logbuf); }
+#ifdef CONFIG_ITRACE
+  // only disassemble the instruction when it is really printed
+  extern bool log_enable();
+  bool log_it = ITRACE_COND && log_enable();
+  if (log_it || g_print_step) {
+    void itrace_format(char *str, int size, vaddr_t pc, uint8_t *inst, int ilen);
+    itrace_format(_this->logbuf, sizeof(_this->logbuf), _this->pc,
+        (uint8_t *)&_this->isa.inst, _this->snpc - _this->pc);
+  }
+  if (log_it) { log_write("%s\n", _this->logbuf); }
+  if (g_print_step) { puts(_this->logbuf); }
+#endif
+#ifdef CONFIG_BTRACE
+  if (btrace_enable()) {
+    btrace_inst(_this->pc, (uint8_t *)&_this->isa.inst, _this->snpc - _this->pc);
+  }
+#endif
+#ifdef INST_CLASS_ENABLE
+  int cls = isa_inst_class(_this);
+  if (rev_live()) {
+    ftrace_step(_this, cls);
+    perf_step(_this, cls);
+  }
+  bool mispredict = bpred_step(_this, cls);
+  timing_step(_this, cls, mispredict);
 #endif
-  if (g_print_step) { IFDEF(CONFIG_ITRACE, puts(_this->logbuf)); }
   IFDEF(CONFIG_DIFFTEST, difftest_step(_this->pc, dnpc));
 }
 
@@ -45,30 +77,7 @@ static void exec_once(Decode *s, vaddr_t pc) {
   s->snpc = pc;
   isa_exec_once(s);
   cpu.pc = s->dnpc;
-#ifdef CONFIG_ITRACE
-  char *p = s->logbuf;
-  p += snprintf(p, sizeof(s->logbuf), FMT_WORD ":", s->pc);
-  int ilen = s->snpc - s->pc;
-  int i;
-  uint8_t *inst = (uint8_t *)&s->isa.inst;
-#ifdef CONFIG_ISA_x86
-  for (i = 0; i < ilen; i ++) {
-#else
-  for (i = ilen - 1; i >= 0; i --) {
-#endif
-    p += snprintf(p, 4, " %02x", inst[i]);
-  }
-  int ilen_max = MUXDEF(CONFIG_ISA_x86, 8, 4);
-  int space_len = ilen_max - ilen;
-  if (space_len < 0) space_len = 0;
-  space_len = space_len * 3 + 1;
-  memset(p, ' ', space_len);
-  p += space_len;
-
-  void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte);
-  disassemble(p, s->logbuf + sizeof(s->logbuf) - p,
-      MUXDEF(CONFIG_ISA_x86, s->snpc, s->pc), (uint8_t *)&s->isa.inst, ilen);
-#endif
+  iqueue_push(s->pc, &s->isa.inst, s->snpc - s->pc);
 }
 
 static void execute(uint64_t n) {
@@ -81,8 +90,31 @@ static void execute(uint64_t n) {
     }
     g_nr_guest_inst ++;
     trace_and_difftest(&s, cpu.pc);
+    // after the models are stepped, so that a snapshot has the whole instruction
+    IFDEF(CONFIG_REVERSE, if (unlikely(g_nr_guest_inst == rev_next_event)) rev_event());
     if (nemu_state.state != NEMU_RUNNING) break;
     IFDEF(CONFIG_DEVICE, device_update());
+    idle_check();
+    // stop before the next instruction, so that the first one of each
+    // cpu_exec() steps over the breakpoint which stops the last one
+    if (unlikely(nr_breakpoint != 0) && check_breakpoint(cpu.pc)) {
+      nemu_state.state = NEMU_STOP;
+      break;
+    }
+  }
+}
+
+// REF of differential testing only needs the architectural state,
+// so it runs without the tracers, devices and checks in execute().
+// It stops at a trap or an invalid instruction like execute().
+void cpu_exec_ref(uint64_t n) {
+  Decode s;
+  for (; n > 0 && nemu_state.state == NEMU_RUNNING; n --) {
+    s.pc = cpu.pc;
+    s.snpc = cpu.pc;
+    isa_exec_once(&s);
+    cpu.pc = s.dnpc;
+    g_nr_guest_inst ++;
   }
 }
 
@@ -93,9 +125,16 @@ static void statistic() {
   Log("total guest instructions = " NUMBERIC_FMT, g_nr_guest_inst);
   if (g_timer > 0) Log("simulation frequency = " NUMBERIC_FMT " inst/s", g_nr_guest_inst * 1000000 / g_timer);
   else Log("Finish running in less than 1 us and can not calculate the simulation frequency");
+  cache_statistic();
+  bpred_statistic();
+  timing_statistic();
+  ftrace_report();
+  perf_report();
 }
 
 void assert_fail_msg() {
+  IFDEF(CONFIG_BTRACE, btrace_flush());
+  iqueue_dump();
   isa_reg_display();
   statistic();
 }
@@ -121,6 +160,7 @@ void cpu_exec(uint64_t n) {
     case NEMU_RUNNING: nemu_state.state = NEMU_STOP; break;
 
     case NEMU_END: case NEMU_ABORT:
+      if (nemu_state.state == NEMU_ABORT || nemu_state.halt_ret != 0) iqueue_dump();
       Log("nemu: %s at pc = " FMT_WORD,
           (nemu_state.state == NEMU_ABORT ? ANSI_FMT("ABORT", ANSI_FG_RED) :
            (nemu_state.halt_ret == 0 ? ANSI_FMT("HIT GOOD TRAP", ANSI_FG_GREEN) :
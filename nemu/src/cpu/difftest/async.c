@@ -0,0 +1,221 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/difftest.h>
+#include <utils.h>
+
+#ifdef CONFIG_DIFFTEST_ASYNC
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <unistd.h>
+
+/* REF runs in its own thread, behind DUT by up to RING_SIZE commits. DUT
+ * commits each instruction into a single-producer single-consumer ring,
+ * with the stores to pmem first and the registers after it last. The REF
+ * thread runs the instruction and checks them. DUT only waits when the
+ * ring is full, when REF reports a mismatch, and before it calls REF
+ * directly, which requires the ring to be drained. */
+
+#define RING_SIZE 4096
+
+enum { COMMIT_INST, COMMIT_SYNC, COMMIT_STORE };
+
+typedef struct {
+  int type;
+  int len;        // of COMMIT_STORE
+  paddr_t addr;   // of COMMIT_STORE
+  word_t data;    // of COMMIT_STORE
+  vaddr_t pc;     // of the instruction
+  uint64_t inst;  // the instruction count after it
+  CPU_state dut;  // registers after it
+} Commit;
+
+static Commit ring[RING_SIZE];
+// only written by DUT and by REF respectively
+static atomic_size_t ring_head = 0, ring_tail = 0;
+static size_t head = 0;
+
+// a mismatch found by REF, until DUT judges it
+static atomic_bool ref_bad = false;
+static Commit bad_inst, bad_store;
+static CPU_state bad_ref;
+static word_t bad_ref_data;
+
+extern uint64_t g_nr_guest_inst;
+bool difftest_async_direct = false;
+
+static void wait_a_while(int *spin) {
+  (*spin) ++;
+  if (*spin < 1000) return;
+  if (*spin < 100000) sched_yield();
+  else usleep(100);
+}
+
+static word_t store_mask(int len) {
+  return (len >= sizeof(word_t) ? (word_t)-1 : ((word_t)1 << (len * 8)) - 1);
+}
+
+static bool overlap(Commit *a, Commit *b) {
+  return a->addr < b->addr + b->len && b->addr < a->addr + a->len;
+}
+
+// runs in the REF thread
+static void ref_check(Commit *c, Commit *store, int nr_store) {
+  CPU_state ref_r;
+  ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
+  bool ok = (memcmp(&ref_r, &c->dut, DIFFTEST_REG_SIZE) == 0);
+  bad_store.len = 0;
+#ifdef CONFIG_DIFFTEST_MEM
+  for (int i = nr_store - 1; ok && i >= 0; i --) {
+    // only the last store to the same bytes is seen
+    bool later = false;
+    for (int j = i + 1; j < nr_store; j ++) later |= overlap(&store[i], &store[j]);
+    if (later) continue;
+    word_t data = 0;
+    ref_difftest_memcpy(store[i].addr, &data, store[i].len, DIFFTEST_TO_DUT);
+    if (data != (store[i].data & store_mask(store[i].len))) {
+      ok = false;
+      bad_store = store[i];
+      bad_ref_data = data;
+    }
+  }
+#endif
+  if (ok) return;
+
+  bad_inst = *c;
+  bad_ref = ref_r;
+  atomic_store_explicit(&ref_bad, true, memory_order_release);
+  int spin = 0;
+  while (atomic_load_explicit(&ref_bad, memory_order_acquire)) wait_a_while(&spin);
+}
+
+static void *ref_thread(void *arg) {
+  Commit *store = NULL;
+  int nr_store = 0, cap_store = 0;
+  size_t tail = 0;
+  while (true) {
+    int spin = 0;
+    while (atomic_load_explicit(&ring_head, memory_order_acquire) == tail) wait_a_while(&spin);
+    Commit *c = &ring[tail % RING_SIZE];
+    switch (c->type) {
+      case COMMIT_STORE:
+        if (nr_store == cap_store) {
+          cap_store = (cap_store == 0 ? 16 : cap_store * 2);
+          store = realloc(store, sizeof(store[0]) * cap_store);
+          assert(store);
+        }
+        store[nr_store ++] = *c;
+        break;
+      case COMMIT_SYNC:
+        // REF skips the instruction, but gets its result
+        for (int i = 0; i < nr_store; i ++) {
+          ref_difftest_memcpy(store[i].addr, &store[i].data, store[i].len, DIFFTEST_TO_REF);
+        }
+        ref_difftest_regcpy(&c->dut, DIFFTEST_TO_REF);
+        nr_store = 0;
+        break;
+      default:
+        ref_difftest_exec(1);
+        ref_check(c, store, nr_store);
+        nr_store = 0;
+        break;
+    }
+    tail ++;
+    atomic_store_explicit(&ring_tail, tail, memory_order_release);
+  }
+  return NULL;
+}
+
+// judge the mismatch reported by REF with the check of the ISA
+static void dut_judge() {
+  if (likely(!atomic_load_explicit(&ref_bad, memory_order_acquire))) return;
+  if (nemu_state.state != NEMU_ABORT) {
+    CPU_state now = cpu;
+    cpu = bad_inst.dut;
+    bool ok = (bad_store.len == 0 && isa_difftest_checkregs(&bad_ref, bad_inst.pc));
+    if (bad_store.len != 0) {
+      Log("pmem at " FMT_PADDR " is different after executing instruction at pc = " FMT_WORD
+          ", right = " FMT_WORD ", wrong = " FMT_WORD,
+          bad_store.addr, bad_inst.pc, bad_ref_data, bad_store.data & store_mask(bad_store.len));
+    }
+    if (!ok) {
+      Log("The wrong instruction is the %" PRIu64 "th one, DUT has run %" PRIu64 " instructions",
+          bad_inst.inst, g_nr_guest_inst);
+      isa_reg_display();
+      nemu_state.state = NEMU_ABORT;
+      nemu_state.halt_pc = bad_inst.pc;
+    }
+    cpu = now;
+  }
+  atomic_store_explicit(&ref_bad, false, memory_order_release);
+}
+
+static Commit *ring_slot() {
+  int spin = 0;
+  while (head - atomic_load_explicit(&ring_tail, memory_order_acquire) == RING_SIZE) {
+    dut_judge();
+    wait_a_while(&spin);
+  }
+  return &ring[head % RING_SIZE];
+}
+
+static void ring_push() {
+  head ++;
+  atomic_store_explicit(&ring_head, head, memory_order_release);
+}
+
+void difftest_async_store(paddr_t addr, int len, word_t data) {
+  if (difftest_async_direct) return;
+  Commit *c = ring_slot();
+  c->type = COMMIT_STORE;
+  c->addr = addr;
+  c->len = len;
+  c->data = data;
+  ring_push();
+}
+
+void difftest_async_step(vaddr_t pc, bool sync) {
+  Commit *c = ring_slot();
+  c->type = (sync ? COMMIT_SYNC : COMMIT_INST);
+  c->pc = pc;
+  c->inst = g_nr_guest_inst;
+  c->dut = cpu;
+  ring_push();
+  dut_judge();
+  // report all mismatches before the guest ends
+  if (nemu_state.state != NEMU_RUNNING) difftest_async_drain();
+}
+
+void difftest_async_drain() {
+  int spin = 0;
+  while (atomic_load_explicit(&ring_tail, memory_order_acquire) != head) {
+    dut_judge();
+    wait_a_while(&spin);
+  }
+}
+
+void difftest_async_init() {
+  pthread_t thread;
+  int ret = pthread_create(&thread, NULL, ref_thread, NULL);
+  Assert(ret == 0, "Can not create the thread of REF");
+  pthread_detach(thread);
+}
+
+#endif
@@ -17,6 +17,7 @@
 
 #include <isa.h>
 #include <cpu/cpu.h>
+#include <cpu/difftest.h>
 #include <memory/paddr.h>
 #include <utils.h>
 #include <difftest-def.h>
@@ -25,15 +26,100 @@ void (*ref_difftest_memcpy)(paddr_t addr, void *buf, size_t n, bool direction) =
 void (*ref_difftest_regcpy)(void *dut, bool direction) = NULL;
 void (*ref_difftest_exec)(uint64_t n) = NULL;
 void (*ref_difftest_raise_intr)(uint64_t NO) = NULL;
+uint64_t (*ref_difftest_memhash)(paddr_t addr, size_t n) = NULL;
 
 #ifdef CONFIG_DIFFTEST
 
 static bool is_skip_ref = false;
 static int skip_dut_nr_inst = 0;
 
+#define PAGE_SIZE 4096
+
+extern uint64_t g_nr_guest_inst;
+
+// pages of pmem written since the last check, as a bitmap and a list
+uint64_t difftest_dirty[(CONFIG_MSIZE / PAGE_SIZE + 63) / 64] = {};
+static paddr_t *dirty = NULL;
+static int nr_dirty = 0, cap_dirty = 0;
+
+#ifdef CONFIG_DIFFTEST_BATCH
+static uint8_t (*undo)[PAGE_SIZE] = NULL;
+static void batch_flush();
+#endif
+#ifdef CONFIG_DIFFTEST_MEM
+// pages of pmem given to REF, which only gets the image initially
+static uint64_t ref_synced[(CONFIG_MSIZE / PAGE_SIZE + 63) / 64] = {};
+#endif
+
+void difftest_dirty_page(paddr_t pg) {
+  difftest_dirty[pg / 64] |= 1ull << (pg % 64);
+  if (nr_dirty == cap_dirty) {
+    cap_dirty = (cap_dirty == 0 ? 16 : cap_dirty * 2);
+    dirty = realloc(dirty, sizeof(dirty[0]) * cap_dirty);
+    assert(dirty);
+#ifdef CONFIG_DIFFTEST_BATCH
+    undo = realloc(undo, sizeof(undo[0]) * cap_dirty);
+    assert(undo);
+#endif
+  }
+  paddr_t addr = CONFIG_MBASE + pg * PAGE_SIZE;
+  // keep the old content to restore the agreed state
+  IFDEF(CONFIG_DIFFTEST_BATCH, memcpy(undo[nr_dirty], guest_to_host(addr), PAGE_SIZE));
+  dirty[nr_dirty ++] = pg;
+#ifdef CONFIG_DIFFTEST_MEM
+  // REF has not run the instruction yet, so the old content is also its content
+  if (!(ref_synced[pg / 64] & (1ull << (pg % 64))) && ref_difftest_memcpy != NULL) {
+    ref_synced[pg / 64] |= 1ull << (pg % 64);
+    ref_difftest_memcpy(addr, guest_to_host(addr), PAGE_SIZE, DIFFTEST_TO_REF);
+  }
+#endif
+}
+
+static void dirty_clear() {
+  for (int i = 0; i < nr_dirty; i ++) {
+    difftest_dirty[dirty[i] / 64] &= ~(1ull << (dirty[i] % 64));
+  }
+  nr_dirty = 0;
+}
+
+// copy the pages written by instructions which REF skips
+static void dirty_to_ref() {
+  for (int i = 0; i < nr_dirty; i ++) {
+    paddr_t addr = CONFIG_MBASE + dirty[i] * PAGE_SIZE;
+    ref_difftest_memcpy(addr, guest_to_host(addr), PAGE_SIZE, DIFFTEST_TO_REF);
+  }
+  dirty_clear();
+}
+
+#ifdef CONFIG_DIFFTEST_MEM
+// compare the written pages by hash if REF supports, or by copying them
+static bool dirty_equal(vaddr_t pc) {
+  static uint8_t buf[PAGE_SIZE];
+  for (int i = 0; i < nr_dirty; i ++) {
+    paddr_t addr = CONFIG_MBASE + dirty[i] * PAGE_SIZE;
+    bool equal;
+    if (ref_difftest_memhash != NULL) {
+      equal = (ref_difftest_memhash(addr, PAGE_SIZE) == difftest_hash(guest_to_host(addr), PAGE_SIZE));
+    } else {
+      ref_difftest_memcpy(addr, buf, PAGE_SIZE, DIFFTEST_TO_DUT);
+      equal = (memcmp(buf, guest_to_host(addr), PAGE_SIZE) == 0);
+    }
+    if (!equal) {
+      Log("pmem page at " FMT_PADDR " is different after executing instruction at pc = " FMT_WORD,
+          addr, pc);
+      return false;
+    }
+  }
+  return true;
+}
+#else
+static bool dirty_equal(vaddr_t pc) { return true; }
+#endif
+
 // this is used to let ref skip instructions which
 // can not produce consistent behavior with NEMU
 void difftest_skip_ref() {
+  IFDEF(CONFIG_DIFFTEST_BATCH, if (!is_skip_ref && skip_dut_nr_inst == 0) batch_flush());
   is_skip_ref = true;
   // If such an instruction is one of the instruction packing in QEMU
   // (see below), we end the process of catching up with QEMU's pc to
@@ -52,6 +138,11 @@ void difftest_skip_ref() {
 //   Let REF run `nr_ref` instructions first.
 //   We expect that DUT will catch up with REF within `nr_dut` instructions.
 void difftest_skip_dut(int nr_ref, int nr_dut) {
+  IFDEF(CONFIG_DIFFTEST_BATCH, if (!is_skip_ref && skip_dut_nr_inst == 0) batch_flush());
+#ifdef CONFIG_DIFFTEST_ASYNC
+  difftest_async_drain();
+  difftest_async_direct = true;
+#endif
   skip_dut_nr_inst += nr_dut;
 
   while (nr_ref -- > 0) {
@@ -59,6 +150,105 @@ void difftest_skip_dut(int nr_ref, int nr_dut) {
   }
 }
 
+#ifdef CONFIG_DIFFTEST_BATCH
+/* DUT and REF run a batch of instructions before their registers are
+ * compared. The batch is doubled while they agree. On a mismatch, both
+ * are restored to the last state they agree, and the batch is halved
+ * until it is the single wrong instruction. Accessing devices ends the
+ * batch, so restoring never re-executes the accesses.
+ *
+ * To restore pmem of DUT, the old content of the pages written first
+ * after the agreed state is kept. REF gets a copy of the whole pmem,
+ * since it may write different pages. */
+
+// the last state where DUT and REF agree
+static CPU_state agreed_cpu;
+static uint64_t agreed_inst = 0;
+// the first instruction count known to disagree, or 0 if not bisecting
+static uint64_t bad_inst = 0;
+static uint64_t batch = 1;
+static bool flush_mismatch = false;
+
+static void batch_agree() {
+  agreed_cpu = cpu;
+  agreed_inst = g_nr_guest_inst;
+  dirty_clear();
+  if (bad_inst == 0) {
+    batch = (batch * 2 > CONFIG_DIFFTEST_BATCH_MAX ? CONFIG_DIFFTEST_BATCH_MAX : batch * 2);
+  } else if (agreed_inst >= bad_inst) {
+    // the mismatch is not reproduced
+    bad_inst = 0;
+    batch = 1;
+  } else {
+    batch = (bad_inst - agreed_inst) / 2;
+    if (batch == 0) batch = 1;
+  }
+}
+
+// the state is changed outside difftest, and already copied to REF
+void difftest_batch_reset() {
+  bad_inst = 0;
+  batch = 1;
+  batch_agree();
+}
+
+static void batch_restore() {
+  for (int i = 0; i < nr_dirty; i ++) {
+    paddr_t addr = CONFIG_MBASE + dirty[i] * PAGE_SIZE;
+    memcpy(guest_to_host(addr), undo[i], PAGE_SIZE);
+    IFDEF(CONFIG_CHECKPOINT, pmem_mark_dirty(addr, PAGE_SIZE));
+  }
+  dirty_clear();
+  cpu = agreed_cpu;
+  g_nr_guest_inst = agreed_inst;
+  is_skip_ref = false;
+  skip_dut_nr_inst = 0;
+  ref_difftest_memcpy(CONFIG_MBASE, guest_to_host(CONFIG_MBASE), CONFIG_MSIZE, DIFFTEST_TO_REF);
+  ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+}
+
+static bool batch_check(vaddr_t pc) {
+  CPU_state ref_r;
+  uint64_t n = g_nr_guest_inst - agreed_inst;
+  if (n > 0) ref_difftest_exec(n);
+  ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
+  return isa_difftest_checkregs(&ref_r, pc) && dirty_equal(pc);
+}
+
+// a mismatch after the agreed state, restore and run the first half
+static void batch_bisect() {
+  Log("Mismatch within instruction count (%" PRIu64 ", %" PRIu64 "], bisecting",
+      agreed_inst, g_nr_guest_inst);
+  bad_inst = g_nr_guest_inst;
+  batch = (bad_inst - agreed_inst) / 2;
+  if (batch == 0) batch = 1;
+  batch_restore();
+  // the run goes on from the agreed state, even if it has ended
+  nemu_state.state = NEMU_RUNNING;
+}
+
+// called before an instruction accessing devices, whose result REF can not
+// reproduce, to check the instructions before it
+static void batch_flush() {
+  if (g_nr_guest_inst == agreed_inst) return;
+  if (batch_check(cpu.pc)) batch_agree();
+  else flush_mismatch = true;
+}
+
+static void batch_step(vaddr_t pc) {
+  if (g_nr_guest_inst - agreed_inst < batch && nemu_state.state == NEMU_RUNNING) return;
+  if (batch_check(pc)) batch_agree();
+  else if (g_nr_guest_inst - agreed_inst > 1) batch_bisect();
+  else {
+    // this is the first wrong instruction
+    nemu_state.state = NEMU_ABORT;
+    nemu_state.halt_pc = pc;
+    isa_reg_display();
+    bad_inst = 0;
+  }
+}
+#endif
+
 void init_difftest(char *ref_so_file, long img_size, int port) {
   assert(ref_so_file != NULL);
 
@@ -78,21 +268,35 @@ void init_difftest(char *ref_so_file, long img_size, int port) {
   ref_difftest_raise_intr = dlsym(handle, "difftest_raise_intr");
   assert(ref_difftest_raise_intr);
 
+  // optional, the written pages are copied from REF to compare without it
+  ref_difftest_memhash = dlsym(handle, "difftest_memhash");
+
   void (*ref_difftest_init)(int) = dlsym(handle, "difftest_init");
   assert(ref_difftest_init);
 
   Log("Differential testing: %s", ANSI_FMT("ON", ANSI_FG_GREEN));
+#if defined(CONFIG_DIFFTEST_BATCH)
+  Log("The result is compared with %s after batches of up to %d instructions, "
+      "which are bisected to find the first wrong instruction on a mismatch.",
+      ref_so_file, CONFIG_DIFFTEST_BATCH_MAX);
+#elif defined(CONFIG_DIFFTEST_ASYNC)
+  Log("The result of every instruction is compared with %s in another thread, "
+      "which runs behind NEMU.", ref_so_file);
+#else
   Log("The result of every instruction will be compared with %s. "
       "This will help you a lot for debugging, but also significantly reduce the performance. "
       "If it is not necessary, you can turn it off in menuconfig.", ref_so_file);
+#endif
 
   ref_difftest_init(port);
   ref_difftest_memcpy(RESET_VECTOR, guest_to_host(RESET_VECTOR), img_size, DIFFTEST_TO_REF);
   ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+  IFDEF(CONFIG_DIFFTEST_BATCH, difftest_batch_reset());
+  IFDEF(CONFIG_DIFFTEST_ASYNC, difftest_async_init());
 }
 
 static void checkregs(CPU_state *ref, vaddr_t pc) {
-  if (!isa_difftest_checkregs(ref, pc)) {
+  if (!isa_difftest_checkregs(ref, pc) || !dirty_equal(pc)) {
     nemu_state.state = NEMU_ABORT;
     nemu_state.halt_pc = pc;
     isa_reg_display();
@@ -102,11 +306,23 @@ static void checkregs(CPU_state *ref, vaddr_t pc) {
 void difftest_step(vaddr_t pc, vaddr_t npc) {
   CPU_state ref_r;
 
+#ifdef CONFIG_DIFFTEST_BATCH
+  if (flush_mismatch) {
+    // the instructions before this one are wrong
+    flush_mismatch = false;
+    g_nr_guest_inst --;
+    batch_bisect();
+    return;
+  }
+#endif
+
   if (skip_dut_nr_inst > 0) {
     ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
     if (ref_r.pc == npc) {
       skip_dut_nr_inst = 0;
       checkregs(&ref_r, npc);
+      MUXDEF(CONFIG_DIFFTEST_BATCH, batch_agree(), dirty_clear());
+      IFDEF(CONFIG_DIFFTEST_ASYNC, difftest_async_direct = false);
       return;
     }
     skip_dut_nr_inst --;
@@ -115,17 +331,31 @@ void difftest_step(vaddr_t pc, vaddr_t npc) {
     return;
   }
 
+#ifdef CONFIG_DIFFTEST_ASYNC
+  difftest_async_direct = false;
+  difftest_async_step(pc, is_skip_ref);
+  is_skip_ref = false;
+  return;
+#endif
+
   if (is_skip_ref) {
     // to skip the checking of an instruction, just copy the reg state to reference design
     ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+    dirty_to_ref();
     is_skip_ref = false;
+    IFDEF(CONFIG_DIFFTEST_BATCH, batch_agree());
     return;
   }
 
+#ifdef CONFIG_DIFFTEST_BATCH
+  batch_step(pc);
+#else
   ref_difftest_exec(1);
   ref_difftest_regcpy(&ref_r, DIFFTEST_TO_DUT);
 
   checkregs(&ref_r, pc);
+  dirty_clear();
+#endif
 }
 #else
 void init_difftest(char *ref_so_file, long img_size, int port) { }
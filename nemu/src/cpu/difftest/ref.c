@@ -19,19 +19,44 @@
 #include <memory/paddr.h>
 
 __EXPORT void difftest_memcpy(paddr_t addr, void *buf, size_t n, bool direction) {
-  assert(0);
+  if (direction == DIFFTEST_TO_REF) memcpy(guest_to_host(addr), buf, n);
+  else memcpy(buf, guest_to_host(addr), n);
 }
 
+__EXPORT uint64_t difftest_memhash(paddr_t addr, size_t n) {
+  return difftest_hash(guest_to_host(addr), n);
+}
+
+#ifdef CONFIG_TARGET_SHARE
+// optional, map the whole memory of DUT in file `fd' instead of copying it,
+// DUT should also map the file private and never write the file itself,
+// since the pages not written by REF still follow the file
+__EXPORT void difftest_memmap(int fd) {
+  pmem_map(fd);
+}
+#endif
+
 __EXPORT void difftest_regcpy(void *dut, bool direction) {
-  assert(0);
+  if (direction == DIFFTEST_TO_REF) {
+    memcpy(&cpu, dut, DIFFTEST_REG_SIZE);
+    // DUT may bring REF back from where it has stopped
+    nemu_state.state = NEMU_RUNNING;
+  }
+  else memcpy(dut, &cpu, DIFFTEST_REG_SIZE);
+}
+
+// optional, the registers of REF in the layout of `difftest_regcpy', which
+// DUT can read and write in place instead of copying them after every step
+__EXPORT void *difftest_regptr() {
+  return &cpu;
 }
 
 __EXPORT void difftest_exec(uint64_t n) {
-  assert(0);
+  cpu_exec_ref(n);
 }
 
 __EXPORT void difftest_raise_intr(word_t NO) {
-  assert(0);
+  cpu.pc = isa_raise_intr(NO, cpu.pc);
 }
 
 __EXPORT void difftest_init(int port) {
@@ -39,4 +64,5 @@ __EXPORT void difftest_init(int port) {
   init_mem();
   /* Perform ISA dependent initialization. */
   init_isa();
+  nemu_state.state = NEMU_RUNNING;
 }
@@ -0,0 +1,181 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <cpu/ftrace.h>
+
+#ifdef CONFIG_FTRACE
+
+/* Calls are recorded in a call tree, where each node is a function called
+ * along a distinct call path. Instructions are charged to the function on
+ * the top of the shadow stack when it changes, so nothing is done for the
+ * instructions which do not call or return. */
+
+typedef struct {
+  int sym;       // index of symbol[], or -1 if it is unknown
+  int parent, child, sibling;
+  uint64_t self; // instructions executed in this function itself
+  uint64_t calls;
+} Node;
+
+#define STACK_DEPTH 4096
+
+extern uint64_t g_nr_guest_inst;
+static Node *node = NULL;
+static int nr_node = 0, cap_node = 0;
+static int stack[STACK_DEPTH];
+static int sp = -1;
+static int nr_overflow = 0; // calls which are too deep to be pushed
+static uint64_t last_charge = 0;
+static const char *folded_file = NULL;
+
+static int new_node(int sym, int parent) {
+  if (nr_node == cap_node) {
+    cap_node = (cap_node == 0 ? 1024 : cap_node * 2);
+    node = realloc(node, sizeof(Node) * cap_node);
+    assert(node);
+  }
+  node[nr_node] = (Node) { .sym = sym, .parent = parent, .child = -1, .sibling = -1 };
+  if (parent != -1) {
+    node[nr_node].sibling = node[parent].child;
+    node[parent].child = nr_node;
+  }
+  return nr_node ++;
+}
+
+static int get_child(int parent, int sym) {
+  for (int i = node[parent].child; i != -1; i = node[i].sibling) {
+    if (node[i].sym == sym) return i;
+  }
+  return new_node(sym, parent);
+}
+
+static inline void charge() {
+  node[stack[sp]].self += g_nr_guest_inst - last_charge;
+  last_charge = g_nr_guest_inst;
+}
+
+static const char *sym_name(int sym) {
+  return (sym == -1 ? "??" : symbol[sym].name);
+}
+
+static void push(vaddr_t target) {
+  if (sp + 1 == STACK_DEPTH) { nr_overflow ++; return; }
+  int n = get_child(stack[sp], symbol_find(target));
+  node[n].calls ++;
+  stack[++ sp] = n;
+}
+
+void ftrace_step(Decode *s, int cls) {
+  if (nr_symbol == 0) return;
+  if (unlikely(sp == -1)) {
+    stack[++ sp] = new_node(symbol_find(s->pc), -1);
+    node[0].calls = 1;
+  }
+
+  if (likely(cls != INST_CALL && cls != INST_RET && cls != INST_JUMP)) return;
+
+  if (cls == INST_CALL) {
+    charge();
+    log_write("%*scall [%s@" FMT_WORD "]\n", sp * 2, "", sym_name(symbol_find(s->dnpc)), s->dnpc);
+    push(s->dnpc);
+  } else if (cls == INST_RET) {
+    charge();
+    log_write("%*sret  [%s]\n", (sp > 0 ? sp * 2 - 2 : 0), "", sym_name(node[stack[sp]].sym));
+    if (nr_overflow > 0) nr_overflow --;
+    else if (sp > 0) sp --;
+  } else {
+    // a jump to the entry of another function is a tail call
+    int sym = symbol_find(s->dnpc);
+    if (sym == -1 || symbol[sym].addr != s->dnpc || sym == node[stack[sp]].sym) return;
+    charge();
+    log_write("%*sjump [%s@" FMT_WORD "]\n", sp * 2, "", sym_name(sym), s->dnpc);
+    if (nr_overflow == 0 && sp > 0) sp --;
+    push(s->dnpc);
+  }
+}
+
+static void write_path(FILE *fp, int n) {
+  if (node[n].parent != -1) {
+    write_path(fp, node[n].parent);
+    fputc(';', fp);
+  }
+  fputs(sym_name(node[n].sym), fp);
+}
+
+typedef struct {
+  int sym;
+  uint64_t incl, excl, calls;
+} FuncStat;
+
+static int func_stat_cmp(const void *a, const void *b) {
+  const FuncStat *x = a, *y = b;
+  return (y->incl > x->incl) - (y->incl < x->incl);
+}
+
+void ftrace_report() {
+  if (sp == -1) return;
+  charge();
+
+  // children are always created after their parent
+  uint64_t *incl = calloc(nr_node, sizeof(uint64_t));
+  assert(incl);
+  for (int i = nr_node - 1; i >= 0; i --) {
+    incl[i] += node[i].self;
+    if (node[i].parent != -1) incl[node[i].parent] += incl[i];
+  }
+
+  // index nr_symbol is for unknown code
+  FuncStat *f = calloc(nr_symbol + 1, sizeof(FuncStat));
+  assert(f);
+  for (int i = 0; i <= nr_symbol; i ++) f[i].sym = (i == nr_symbol ? -1 : i);
+  for (int i = 0; i < nr_node; i ++) {
+    FuncStat *p = &f[node[i].sym == -1 ? nr_symbol : node[i].sym];
+    p->excl += node[i].self;
+    p->calls += node[i].calls;
+    // do not count a recursive call twice
+    int a = node[i].parent;
+    while (a != -1 && node[a].sym != node[i].sym) a = node[a].parent;
+    if (a == -1) p->incl += incl[i];
+  }
+  qsort(f, nr_symbol + 1, sizeof(FuncStat), func_stat_cmp);
+  Log("ftrace: %-24s %16s %16s %12s", "function", "inclusive", "exclusive", "calls");
+  for (int i = 0; i < 10 && i <= nr_symbol && f[i].incl > 0; i ++) {
+    Log("ftrace: %-24s %16" PRIu64 " %16" PRIu64 " %12" PRIu64,
+        sym_name(f[i].sym), f[i].incl, f[i].excl, f[i].calls);
+  }
+
+  if (folded_file != NULL) {
+    FILE *fp = fopen(folded_file, "w");
+    Assert(fp, "Can not open '%s'", folded_file);
+    for (int i = 0; i < nr_node; i ++) {
+      if (node[i].self == 0) continue;
+      write_path(fp, i);
+      fprintf(fp, " %" PRIu64 "\n", node[i].self);
+    }
+    fclose(fp);
+    Log("ftrace: folded stacks are written to %s", folded_file);
+  }
+
+  free(incl);
+  free(f);
+}
+
+void init_ftrace(const char *file) {
+  folded_file = file;
+  if (nr_symbol == 0) Log("ftrace is disabled since there is no symbol (--elf)");
+}
+
+#endif
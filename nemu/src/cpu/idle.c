@@ -0,0 +1,36 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <cpu/cpu.h>
+#include <cpu/idle.h>
+
+#ifdef CONFIG_IDLE_DETECT
+uint64_t g_idle_nr_poll = 0;
+uint64_t g_idle_nr_mmio_write = 0;
+
+// the host time to sleep each time the guest is found spinning, unit: us
+#define IDLE_SPIN_SLEEP 1000
+
+void device_idle(uint64_t us);
+
+void idle_spin_detected() {
+  device_idle(IDLE_SPIN_SLEEP);
+}
+#endif
+
+void cpu_wfi() {
+  // sleep until the next device event instead of spinning on `wfi'
+  IFDEF(CONFIG_IDLE_DETECT, device_idle(0));
+}
@@ -0,0 +1,155 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <cpu/perf.h>
+#include <device/map.h>
+#include <memory/cache.h>
+#include <cpu/bpred.h>
+#include <cpu/timing.h>
+
+#ifdef CONFIG_PERF
+
+PerfStat g_perf = {};
+
+extern PerfInstpat *__start_perf_instpat[], *__stop_perf_instpat[];
+extern uint64_t g_nr_guest_inst;
+extern uint64_t g_timer;
+
+#define NR_PERF_MAP 32
+static IOMap *perf_map[NR_PERF_MAP];
+static int nr_perf_map = 0;
+static const char *json_file = NULL;
+
+static const char *class_name[NR_INST_CLASS] = {
+  [INST_OTHER] = "other", [INST_CALL] = "call", [INST_RET] = "ret",
+  [INST_JUMP] = "jump", [INST_BRANCH] = "branch", [INST_LOAD] = "load",
+  [INST_STORE] = "store", [INST_MULDIV] = "muldiv", [INST_SYSTEM] = "system",
+};
+
+void perf_step(Decode *s, int cls) {
+  g_perf.nr_class[cls] ++;
+  if (cls == INST_BRANCH) {
+    if (s->dnpc != s->snpc) g_perf.nr_branch_taken ++;
+    else g_perf.nr_branch_not_taken ++;
+  }
+}
+
+void perf_add_map(IOMap *map) {
+  assert(nr_perf_map < NR_PERF_MAP);
+  perf_map[nr_perf_map ++] = map;
+}
+
+static int instpat_cmp(const void *a, const void *b) {
+  const PerfInstpat *x = a, *y = b;
+  return (y->cnt > x->cnt) - (y->cnt < x->cnt);
+}
+
+static PerfInstpat* sorted_instpat(int *n) {
+  *n = __stop_perf_instpat - __start_perf_instpat;
+  PerfInstpat *p = malloc(sizeof(PerfInstpat) * (*n + 1));
+  assert(p);
+  for (int i = 0; i < *n; i ++) p[i] = *__start_perf_instpat[i];
+  qsort(p, *n, sizeof(PerfInstpat), instpat_cmp);
+  return p;
+}
+
+void perf_display() {
+  int n;
+  PerfInstpat *p = sorted_instpat(&n);
+  printf("%-12s %16s  %s\n", "instpat", "count", "pattern");
+  for (int i = 0; i < n && p[i].cnt > 0; i ++) {
+    printf("%-12s %16" PRIu64 "  %s\n", p[i].name, p[i].cnt, p[i].pattern);
+  }
+  free(p);
+
+  printf("\n%-12s %16s\n", "class", "count");
+  for (int i = 0; i < NR_INST_CLASS; i ++) {
+    printf("%-12s %16" PRIu64 "\n", class_name[i], g_perf.nr_class[i]);
+  }
+
+  printf("\nloads = %" PRIu64 ", stores = %" PRIu64 "\n", g_perf.nr_load, g_perf.nr_store);
+  printf("branches taken = %" PRIu64 ", not taken = %" PRIu64 "\n",
+      g_perf.nr_branch_taken, g_perf.nr_branch_not_taken);
+  printf("traps = %" PRIu64 "\n", g_perf.nr_trap);
+
+  printf("\n%-12s %16s %16s\n", "device", "read", "write");
+  for (int i = 0; i < nr_perf_map; i ++) {
+    printf("%-12s %16" PRIu64 " %16" PRIu64 "\n",
+        perf_map[i]->name, perf_map[i]->nr_read, perf_map[i]->nr_write);
+  }
+}
+
+static void perf_dump_json(FILE *fp) {
+  fprintf(fp, "{\n  \"instructions\": %" PRIu64 ",\n  \"host_time_us\": %" PRIu64 ",\n",
+      g_nr_guest_inst, g_timer);
+
+  int n;
+  PerfInstpat *p = sorted_instpat(&n);
+  fprintf(fp, "  \"instpat\": [");
+  for (int i = 0, first = 1; i < n && p[i].cnt > 0; i ++, first = 0) {
+    fprintf(fp, "%s\n    {\"name\": \"%s\", \"pattern\": \"%s\", \"count\": %" PRIu64 "}",
+        (first ? "" : ","), p[i].name, p[i].pattern, p[i].cnt);
+  }
+  fprintf(fp, "\n  ],\n");
+  free(p);
+
+  fprintf(fp, "  \"class\": {");
+  for (int i = 0; i < NR_INST_CLASS; i ++) {
+    fprintf(fp, "%s\"%s\": %" PRIu64, (i == 0 ? "" : ", "), class_name[i], g_perf.nr_class[i]);
+  }
+  fprintf(fp, "},\n");
+
+  fprintf(fp, "  \"mem\": {\"load\": %" PRIu64 ", \"store\": %" PRIu64 "},\n", g_perf.nr_load, g_perf.nr_store);
+  fprintf(fp, "  \"branch\": {\"taken\": %" PRIu64 ", \"not_taken\": %" PRIu64 "},\n",
+      g_perf.nr_branch_taken, g_perf.nr_branch_not_taken);
+  fprintf(fp, "  \"trap\": %" PRIu64 ",\n", g_perf.nr_trap);
+
+  fprintf(fp, "  \"device\": [");
+  for (int i = 0; i < nr_perf_map; i ++) {
+    fprintf(fp, "%s\n    {\"name\": \"%s\", \"read\": %" PRIu64 ", \"write\": %" PRIu64 "}",
+        (i == 0 ? "" : ","), perf_map[i]->name, perf_map[i]->nr_read, perf_map[i]->nr_write);
+  }
+  fprintf(fp, "\n  ]");
+
+#ifdef CONFIG_CACHE_SIM
+  fprintf(fp, ",\n");
+  cache_dump_json(fp);
+#endif
+#ifdef CONFIG_BPRED
+  fprintf(fp, ",\n");
+  bpred_dump_json(fp);
+#endif
+#ifdef CONFIG_TIMING
+  fprintf(fp, ",\n");
+  timing_dump_json(fp);
+#endif
+  fprintf(fp, "\n}\n");
+}
+
+void perf_report() {
+  if (json_file == NULL) return;
+  FILE *fp = fopen(json_file, "w");
+  Assert(fp, "Can not open '%s'", json_file);
+  perf_dump_json(fp);
+  fclose(fp);
+  Log("Performance counters are written to %s", json_file);
+}
+
+void init_perf(const char *file) {
+  json_file = file;
+}
+
+#endif
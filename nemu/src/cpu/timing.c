@@ -0,0 +1,118 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <cpu/timing.h>
+#include <device/map.h>
+#include <checkpoint.h>
+
+#ifdef CONFIG_TIMING
+
+uint64_t g_cycle = 0;
+bool g_timing_on = true;
+uint64_t g_timing_cycle[NR_TIMING_SRC] = {};
+static uint64_t nr_timed_inst = 0;
+
+static const uint32_t class_latency[NR_INST_CLASS] = {
+  [INST_OTHER]  = CONFIG_TIMING_LAT_ALU,
+  [INST_CALL]   = CONFIG_TIMING_LAT_BRANCH,
+  [INST_RET]    = CONFIG_TIMING_LAT_BRANCH,
+  [INST_JUMP]   = CONFIG_TIMING_LAT_BRANCH,
+  [INST_BRANCH] = CONFIG_TIMING_LAT_BRANCH,
+  [INST_LOAD]   = CONFIG_TIMING_LAT_LOAD,
+  [INST_STORE]  = CONFIG_TIMING_LAT_STORE,
+  [INST_MULDIV] = CONFIG_TIMING_LAT_MULDIV,
+  [INST_SYSTEM] = CONFIG_TIMING_LAT_SYSTEM,
+};
+
+/* Cycles to access a device, looked up by the name of its map.
+ * Devices not listed here cost CONFIG_TIMING_DEVICE_LATENCY cycles. */
+static const struct {
+  const char *name;
+  uint32_t read, write;
+} device_latency[] = {
+  { "serial",     10, 100 },
+  { "rtc",        40,  40 },
+  { "keyboard",   20,  20 },
+  { "vgactl",     10,  10 },
+  { "vmem",        4,   4 },
+  { "audio",      20,  20 },
+  { "audio-sbuf",  4,   4 },
+  { "sdhci",      50,  50 },
+  { "plic",       10,  10 },
+};
+
+static const char *src_name[NR_TIMING_SRC] = {
+  [TIMING_INST] = "inst", [TIMING_CACHE] = "cache",
+  [TIMING_BPRED] = "bpred", [TIMING_DEVICE] = "device",
+};
+
+void timing_add_map(IOMap *map) {
+  map->lat_read = map->lat_write = CONFIG_TIMING_DEVICE_LATENCY;
+  for (int i = 0; i < ARRLEN(device_latency); i ++) {
+    if (strcmp(map->name, device_latency[i].name) == 0) {
+      map->lat_read = device_latency[i].read;
+      map->lat_write = device_latency[i].write;
+      break;
+    }
+  }
+}
+
+void timing_step(Decode *s, int cls, bool mispredict) {
+  if (!g_timing_on) return;
+  nr_timed_inst ++;
+  timing_add(TIMING_INST, class_latency[cls]);
+  IFDEF(CONFIG_BPRED, if (mispredict) timing_add(TIMING_BPRED, CONFIG_TIMING_BPRED_PENALTY));
+}
+
+void timing_set(bool on) {
+  g_timing_on = on;
+}
+
+#ifdef CONFIG_CHECKPOINT
+// the cycle counter is seen by the guest, so it goes with the machine
+void timing_add_ckpt() {
+  ckpt_add("cycle", &g_cycle, sizeof(g_cycle), NULL, NULL);
+  ckpt_add("timing cycles", g_timing_cycle, sizeof(g_timing_cycle), NULL, NULL);
+  ckpt_add("timing inst", &nr_timed_inst, sizeof(nr_timed_inst), NULL, NULL);
+}
+#endif
+
+void timing_display() {
+  printf("timing is %s\n", (g_timing_on ? "on" : "off"));
+  printf("cycles = %" PRIu64 ", instructions = %" PRIu64 ", CPI = %.3f\n", g_cycle, nr_timed_inst,
+      (nr_timed_inst == 0 ? 0 : (double)g_cycle / nr_timed_inst));
+  for (int i = 0; i < NR_TIMING_SRC; i ++) {
+    printf("  %-8s %16" PRIu64 "\n", src_name[i], g_timing_cycle[i]);
+  }
+}
+
+void timing_statistic() {
+  Log("timing: %" PRIu64 " cycles for %" PRIu64 " instructions, CPI = %.3f", g_cycle, nr_timed_inst,
+      (nr_timed_inst == 0 ? 0 : (double)g_cycle / nr_timed_inst));
+  Log("timing: inst %" PRIu64 ", cache %" PRIu64 ", bpred %" PRIu64 ", device %" PRIu64 " cycles",
+      g_timing_cycle[TIMING_INST], g_timing_cycle[TIMING_CACHE],
+      g_timing_cycle[TIMING_BPRED], g_timing_cycle[TIMING_DEVICE]);
+}
+
+void timing_dump_json(FILE *fp) {
+  fprintf(fp, "  \"timing\": {\"cycle\": %" PRIu64 ", \"instructions\": %" PRIu64, g_cycle, nr_timed_inst);
+  for (int i = 0; i < NR_TIMING_SRC; i ++) {
+    fprintf(fp, ", \"%s\": %" PRIu64, src_name[i], g_timing_cycle[i]);
+  }
+  fprintf(fp, "}");
+}
+
+#endif
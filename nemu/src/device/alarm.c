@@ -28,13 +28,17 @@ void add_alarm_handle(alarm_handler_t h) {
   handler[idx ++] = h;
 }
 
-static void alarm_sig_handler(int signum) {
+void alarm_trigger() {
   int i;
   for (i = 0; i < idx; i ++) {
     handler[i]();
   }
 }
 
+static void alarm_sig_handler(int signum) {
+  alarm_trigger();
+}
+
 void init_alarm() {
   struct sigaction s;
   memset(&s, 0, sizeof(s));
@@ -16,11 +16,17 @@
 #include <common.h>
 #include <utils.h>
 #include <device/alarm.h>
+#include <device/intr.h>
+#include <cpu/reverse.h>
 #ifndef CONFIG_TARGET_AM
 #include <SDL2/SDL.h>
+#include <unistd.h>
 #endif
 
 void init_map();
+void init_intr();
+void map_add_ckpt();
+void init_plic();
 void init_serial();
 void init_timer();
 void init_vga();
@@ -32,9 +38,13 @@ void init_alarm();
 
 void send_key(uint8_t, bool);
 void vga_update_screen();
+void serial_rx_collect();
+
+static uint64_t last = 0;
 
 void device_update() {
-  static uint64_t last = 0;
+  // the devices wait at the end of the recorded history
+  IFDEF(CONFIG_REVERSE, if (rev_replaying) return);
   uint64_t now = get_time();
   if (now - last < 1000000 / TIMER_HZ) {
     return;
@@ -42,6 +52,7 @@ void device_update() {
   last = now;
 
   IFDEF(CONFIG_HAS_VGA, vga_update_screen());
+  IFDEF(CONFIG_SERIAL_INPUT_FIFO, serial_rx_collect());
 
 #ifndef CONFIG_TARGET_AM
   SDL_Event event;
@@ -66,6 +77,28 @@ void device_update() {
 #endif
 }
 
+#ifdef CONFIG_IDLE_DETECT
+// Called when the guest is idle. Sleep the host until the next device tick,
+// or for `us' microseconds if it is earlier, unless an external interrupt is
+// pending. The PLIC line falls once the guest claims the source, while the
+// latched timer edge is not acknowledged by any ISA yet, and the tick it
+// stands for is what the sleep waits for anyway.
+void device_idle(uint64_t us) {
+  IFDEF(CONFIG_REVERSE, if (rev_replaying) return);
+  if (dev_ext_intr_pending()) return;
+
+  uint64_t now = get_time();
+  uint64_t next_tick = last + 1000000 / TIMER_HZ;
+  bool wait_tick = (us == 0 || now + us >= next_tick);
+  uint64_t deadline = wait_tick ? next_tick : now + us;
+  if (deadline > now) usleep(deadline - now);
+
+  // the virtual interval timer does not advance while the host is sleeping
+  if (wait_tick) alarm_trigger();
+  device_update();
+}
+#endif
+
 void sdl_clear_event_queue() {
 #ifndef CONFIG_TARGET_AM
   SDL_Event event;
@@ -76,7 +109,9 @@ void sdl_clear_event_queue() {
 void init_device() {
   IFDEF(CONFIG_TARGET_AM, ioe_init());
   init_map();
+  init_intr();
 
+  IFDEF(CONFIG_HAS_PLIC, init_plic());
   IFDEF(CONFIG_HAS_SERIAL, init_serial());
   IFDEF(CONFIG_HAS_TIMER, init_timer());
   IFDEF(CONFIG_HAS_VGA, init_vga());
@@ -86,4 +121,5 @@ void init_device() {
   IFDEF(CONFIG_HAS_SDCARD, init_sdcard());
 
   IFNDEF(CONFIG_TARGET_AM, init_alarm());
+  IFDEF(CONFIG_CHECKPOINT, map_add_ckpt());
 }
@@ -13,7 +13,41 @@
 * See the Mulan PSL v2 for more details.
 ***************************************************************************************/
 
-#include <isa.h>
+#include <device/intr.h>
+#include <checkpoint.h>
+
+/* All devices share a single interrupt pin of the CPU. The timer drives it
+ * with an edge which stays latched until acknowledged, while the PLIC drives
+ * it with a level which follows its claimable sources. No ISA takes the pin
+ * as a CPU interrupt yet, since isa_query_intr() is left to the ISA together
+ * with isa_raise_intr().
+ */
+static bool timer_intr = false;
+static bool ext_intr = false;
 
 void dev_raise_intr() {
+  timer_intr = true;
+}
+
+void dev_set_ext_intr(bool level) {
+  ext_intr = level;
+}
+
+bool dev_intr_pending() {
+  return timer_intr || ext_intr;
+}
+
+bool dev_ext_intr_pending() {
+  return ext_intr;
+}
+
+void dev_ack_intr() {
+  timer_intr = false;
+}
+
+void init_intr() {
+#ifdef CONFIG_CHECKPOINT
+  ckpt_add("timer intr", &timer_intr, sizeof(timer_intr), NULL, NULL);
+  ckpt_add("ext intr", &ext_intr, sizeof(ext_intr), NULL, NULL);
+#endif
 }
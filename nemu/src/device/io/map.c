@@ -17,6 +17,10 @@
 #include <memory/host.h>
 #include <memory/vaddr.h>
 #include <device/map.h>
+#include <cpu/idle.h>
+#include <cpu/timing.h>
+#include <checkpoint.h>
+#include <cpu/reverse.h>
 
 #define IO_SPACE_MAX (32 * 1024 * 1024)
 
@@ -52,12 +56,25 @@ void init_map() {
   p_space = io_space;
 }
 
+#ifdef CONFIG_CHECKPOINT
+// called after all devices are initialized, so only the space in use is saved
+void map_add_ckpt() {
+  // the space of all devices, including vmem and the audio buffer
+  ckpt_add("io space", io_space, p_space - io_space, NULL, NULL);
+}
+#endif
+
 word_t map_read(paddr_t addr, int len, IOMap *map) {
   assert(len >= 1 && len <= 8);
   check_bound(map, addr);
   paddr_t offset = addr - map->low;
+  IFDEF(CONFIG_PERF, if (rev_live()) map->nr_read ++);
+  IFDEF(CONFIG_TIMING, timing_add(TIMING_DEVICE, map->lat_read));
+  // devices are not run when replaying, their outputs are recorded
+  IFDEF(CONFIG_REVERSE, if (rev_replaying) return rev_replay_read());
   invoke_callback(map->callback, offset, len, false); // prepare data to read
   word_t ret = host_read(map->space + offset, len);
+  IFDEF(CONFIG_REVERSE, rev_record_read(ret));
   return ret;
 }
 
@@ -66,5 +83,9 @@ void map_write(paddr_t addr, int len, word_t data, IOMap *map) {
   check_bound(map, addr);
   paddr_t offset = addr - map->low;
   host_write(map->space + offset, len, data);
+  IFDEF(CONFIG_PERF, if (rev_live()) map->nr_write ++);
+  IFDEF(CONFIG_TIMING, timing_add(TIMING_DEVICE, map->lat_write));
+  idle_note_mmio_write();
+  IFDEF(CONFIG_REVERSE, if (rev_replaying) return);
   invoke_callback(map->callback, offset, len, true);
 }
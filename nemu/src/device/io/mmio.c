@@ -15,6 +15,7 @@
 
 #include <device/map.h>
 #include <memory/paddr.h>
+#include <memory/host.h>
 
 #define NR_MAP 16
 
@@ -49,15 +50,23 @@ void add_mmio_map(const char *name, paddr_t addr, void *space, uint32_t len, io_
     .space = space, .callback = callback };
   Log("Add mmio map '%s' at [" FMT_PADDR ", " FMT_PADDR "]",
       maps[nr_map].name, maps[nr_map].low, maps[nr_map].high);
+  IFDEF(CONFIG_PERF, perf_add_map(&maps[nr_map]));
+  IFDEF(CONFIG_TIMING, timing_add_map(&maps[nr_map]));
 
   nr_map ++;
 }
 
 /* bus interface */
 word_t mmio_read(paddr_t addr, int len) {
-  return map_read(addr, len, fetch_mmio_map(addr));
+  word_t ret = map_read(addr, len, fetch_mmio_map(addr));
+  MTRACE(addr, len, ret, false);
+  return ret;
 }
 
 void mmio_write(paddr_t addr, int len, word_t data) {
-  map_write(addr, len, data, fetch_mmio_map(addr));
+  IOMap *map = fetch_mmio_map(addr);
+  // the old value is read from the space without invoking the callback
+  DATA_WATCH(addr, len, (map ? host_read(map->space + (addr - map->low), len) : 0), data);
+  map_write(addr, len, data, map);
+  MTRACE(addr, len, data, true);
 }
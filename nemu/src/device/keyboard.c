@@ -14,7 +14,10 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <device/intr.h>
+#include <cpu/idle.h>
 #include <utils.h>
+#include <checkpoint.h>
 
 #define KEYDOWN_MASK 0x8000
 
@@ -53,6 +56,7 @@ static void key_enqueue(uint32_t am_scancode) {
   key_queue[key_r] = am_scancode;
   key_r = (key_r + 1) % KEY_QUEUE_LEN;
   Assert(key_r != key_f, "key queue overflow!");
+  plic_raise_irq(IRQ_KEYBOARD);
 }
 
 static uint32_t key_dequeue() {
@@ -61,6 +65,7 @@ static uint32_t key_dequeue() {
     key = key_queue[key_f];
     key_f = (key_f + 1) % KEY_QUEUE_LEN;
   }
+  if (key_f == key_r) plic_lower_irq(IRQ_KEYBOARD);
   return key;
 }
 
@@ -86,6 +91,7 @@ static void i8042_data_io_handler(uint32_t offset, int len, bool is_write) {
   assert(!is_write);
   assert(offset == 0);
   i8042_data_port_base[0] = key_dequeue();
+  if (i8042_data_port_base[0] == NEMU_KEY_NONE) idle_note_poll();
 }
 
 void init_i8042() {
@@ -97,4 +103,9 @@ void init_i8042() {
   add_mmio_map("keyboard", CONFIG_I8042_DATA_MMIO, i8042_data_port_base, 4, i8042_data_io_handler);
 #endif
   IFNDEF(CONFIG_TARGET_AM, init_keymap());
+#ifdef CONFIG_CHECKPOINT
+  ckpt_add("key queue", key_queue, sizeof(key_queue), NULL, NULL);
+  ckpt_add("key front", &key_f, sizeof(key_f), NULL, NULL);
+  ckpt_add("key rear", &key_r, sizeof(key_r), NULL, NULL);
+#endif
 }
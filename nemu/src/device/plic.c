@@ -0,0 +1,109 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <device/map.h>
+#include <device/intr.h>
+#include <cpu/idle.h>
+#include <checkpoint.h>
+
+// This is a simplified PLIC with a single context (the only hart in NEMU).
+// The registers are packed into a small window instead of the sparse 64MB
+// layout of the SiFive PLIC, but the semantics are the same:
+//   0x00 - 0x7c: priority of source 0 - 31, 0 means never interrupt
+//   0x80: pending bits (read-only)
+//   0x84: enable bits
+//   0x88: priority threshold
+//   0x8c: claim (read) / complete (write)
+
+#define NR_SRC 32
+
+enum { reg_pending = NR_SRC, reg_enable, reg_threshold, reg_claim, nr_reg };
+
+static_assert(NR_IRQ <= NR_SRC, "too many interrupt sources for the PLIC");
+
+static uint32_t *plic_base = NULL;
+static uint32_t pending = 0;  // requests forwarded by the gateways
+static uint32_t level = 0;    // current level of each interrupt line
+static uint32_t claimed = 0;  // sources being serviced by the guest
+
+static int plic_best_irq() {
+  uint32_t active = pending & plic_base[reg_enable];
+  int best = 0;
+  uint32_t best_prio = plic_base[reg_threshold];
+  for (int i = 1; i < NR_SRC; i ++) {
+    if ((active & (1u << i)) && plic_base[i] > best_prio) {
+      best = i;
+      best_prio = plic_base[i];
+    }
+  }
+  return best;
+}
+
+static void plic_update() {
+  dev_set_ext_intr(plic_best_irq() != 0);
+}
+
+void plic_raise_irq(int irq) {
+  assert(irq > 0 && irq < NR_SRC);
+  uint32_t mask = 1u << irq;
+  level |= mask;
+  // the gateway forwards a new request only after the previous one is completed
+  if (!(claimed & mask)) {
+    pending |= mask;
+    plic_update();
+  }
+}
+
+void plic_lower_irq(int irq) {
+  assert(irq > 0 && irq < NR_SRC);
+  level &= ~(1u << irq);
+}
+
+static void plic_io_handler(uint32_t offset, int len, bool is_write) {
+  assert(len == 4);
+  int idx = offset / 4;
+  if (idx == reg_claim) {
+    if (is_write) {
+      uint32_t irq = plic_base[reg_claim];
+      if (irq > 0 && irq < NR_SRC && (claimed & (1u << irq))) {
+        claimed &= ~(1u << irq);
+        if (level & (1u << irq)) pending |= 1u << irq;
+      }
+    } else {
+      int irq = plic_best_irq();
+      if (irq != 0) {
+        pending &= ~(1u << irq);
+        claimed |= 1u << irq;
+      } else {
+        idle_note_poll();
+      }
+      plic_base[reg_claim] = irq;
+    }
+  }
+  // the pending register is read-only
+  plic_base[reg_pending] = pending;
+  plic_update();
+}
+
+void init_plic() {
+  plic_base = (uint32_t *)new_space(sizeof(uint32_t) * nr_reg);
+  memset(plic_base, 0, sizeof(uint32_t) * nr_reg);
+  add_mmio_map("plic", CONFIG_PLIC_MMIO, plic_base, sizeof(uint32_t) * nr_reg, plic_io_handler);
+#ifdef CONFIG_CHECKPOINT
+  ckpt_add("plic pending", &pending, sizeof(pending), NULL, NULL);
+  ckpt_add("plic level", &level, sizeof(level), NULL, NULL);
+  ckpt_add("plic claimed", &claimed, sizeof(claimed), NULL, NULL);
+#endif
+}
@@ -14,6 +14,8 @@
 ***************************************************************************************/
 
 #include <device/map.h>
+#include <device/intr.h>
+#include <checkpoint.h>
 #include "mmc.h"
 
 // http://www.files.e-shop.co.il/pdastore/Tech-mmc-samsung/SEC%20MMC%20SPEC%20ver09.pdf
@@ -28,8 +30,9 @@
 #define C_SIZE (NR_BLOCK / MULT - 1)
 
 // This is a simple hardware implementation of linux/drivers/mmc/host/bcm2835.c
-// No DMA and IRQ is supported, so the driver must be modified to start PIO
-// right after sending the actual read/write commands.
+// No DMA is supported, so the driver must be modified to start PIO
+// right after sending the actual read/write commands. The end of a
+// multiple block transfer is reported by SDHSTS and the PLIC.
 
 enum {
   SDCMD, SDARG, SDTOUT, SDCDIV,
@@ -40,6 +43,8 @@ enum {
   SDHBLC
 };
 
+#define SDHSTS_BLOCK_IRPT 0x200
+
 static FILE *fp = NULL;
 static uint32_t *base = NULL;
 static uint32_t blkcnt = 0;
@@ -47,6 +52,12 @@ static long blk_addr = 0;
 static uint32_t addr = 0;
 static bool write_cmd = 0;
 static bool read_ext_csd = false;
+static uint32_t hsts = 0;
+
+static void sdcard_block_done() {
+  hsts |= SDHSTS_BLOCK_IRPT;
+  plic_raise_irq(IRQ_SDCARD);
+}
 
 static void prepare_rw(int is_write) {
   blk_addr = base[SDARG];
@@ -98,7 +109,16 @@ static void sdcard_io_handler(uint32_t offset, int len, bool is_write) {
     case SDRSP2:
     case SDRSP3:
       break;
-    case SDDATA:
+    case SDHSTS:
+      // write 1 to clear
+      if (is_write) {
+        hsts &= ~base[SDHSTS];
+        if (!(hsts & SDHSTS_BLOCK_IRPT)) plic_lower_irq(IRQ_SDCARD);
+      }
+      base[SDHSTS] = hsts;
+      break;
+    case SDDATA: {
+       bool is_data = !read_ext_csd;
        if (read_ext_csd) {
          // See section 8.1 JEDEC Standard JED84-A441
          uint32_t data;
@@ -115,13 +135,21 @@ static void sdcard_io_handler(uint32_t offset, int len, bool is_write) {
          else { ret = fwrite(&base[SDDATA], 4, 1, fp); }
        }
        addr += 4;
+       if (is_data && blkcnt != 0 && addr == blkcnt * 512) sdcard_block_done();
        break;
+    }
     default:
       Log("offset = 0x%x(idx = %d), is_write = %d, data = 0x%x", offset, idx, is_write, base[idx]);
       panic("unhandle offset = %d", offset);
   }
 }
 
+#ifdef CONFIG_CHECKPOINT
+static long fpos = 0;
+static void save_pos() { fpos = (fp ? ftell(fp) : 0); }
+static void load_pos() { if (fp) fseek(fp, fpos, SEEK_SET); }
+#endif
+
 void init_sdcard() {
   base = (uint32_t *)new_space(0x80);
   add_mmio_map("sdhci", CONFIG_SDCARD_CTL_MMIO, base, 0x80, sdcard_io_handler);
@@ -131,4 +159,15 @@ void init_sdcard() {
   const char *img = CONFIG_SDCARD_IMG_PATH;
   fp = fopen(img, "r+");
   if (fp == NULL) Log("Can not find sdcard image: %s", img);
+
+#ifdef CONFIG_CHECKPOINT
+  ckpt_add("sdcard blkcnt", &blkcnt, sizeof(blkcnt), NULL, NULL);
+  ckpt_add("sdcard blk_addr", &blk_addr, sizeof(blk_addr), NULL, NULL);
+  ckpt_add("sdcard addr", &addr, sizeof(addr), NULL, NULL);
+  ckpt_add("sdcard write_cmd", &write_cmd, sizeof(write_cmd), NULL, NULL);
+  ckpt_add("sdcard read_ext_csd", &read_ext_csd, sizeof(read_ext_csd), NULL, NULL);
+  ckpt_add("sdcard hsts", &hsts, sizeof(hsts), NULL, NULL);
+  // the position in the middle of a multi-block transfer
+  ckpt_add("sdcard pos", &fpos, sizeof(fpos), save_pos, load_pos);
+#endif
 }
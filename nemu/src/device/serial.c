@@ -15,14 +15,75 @@
 
 #include <utils.h>
 #include <device/map.h>
+#include <device/intr.h>
+#include <cpu/idle.h>
+#include <checkpoint.h>
 
 /* http://en.wikibooks.org/wiki/Serial_Programming/8250_UART_Programming */
 // NOTE: this is compatible to 16550
 
 #define CH_OFFSET 0
+#define LSR_OFFSET 5
+#define LSR_RX_READY 0x01
+#define LSR_TX_READY 0x20
 
 static uint8_t *serial_base = NULL;
 
+#ifdef CONFIG_SERIAL_INPUT_FIFO
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define FIFO_PATH "/tmp/nemu.serial"
+#define QUEUE_LEN 1024
+static char queue[QUEUE_LEN] = {};
+static int f = 0, r = 0;
+static int fifo_fd = -1;
+
+static bool serial_rx_ready() {
+  return f != r;
+}
+
+static void serial_enqueue(char ch) {
+  int next = (r + 1) % QUEUE_LEN;
+  if (next == f) return; // drop the input if the guest is too slow
+  queue[r] = ch;
+  r = next;
+}
+
+static uint8_t serial_dequeue() {
+  uint8_t ch = 0xff;
+  if (f != r) {
+    ch = queue[f];
+    f = (f + 1) % QUEUE_LEN;
+  }
+  plic_set_irq(IRQ_SERIAL, serial_rx_ready());
+  return ch;
+}
+
+// called by device_update() to collect the input written into the FIFO
+void serial_rx_collect() {
+  char buf[128];
+  int n;
+  while ((n = read(fifo_fd, buf, sizeof(buf))) > 0) {
+    for (int i = 0; i < n; i ++) serial_enqueue(buf[i]);
+  }
+  if (serial_rx_ready()) plic_raise_irq(IRQ_SERIAL);
+}
+
+static void init_fifo() {
+  int ret = mkfifo(FIFO_PATH, 0666);
+  Assert(ret == 0 || errno == EEXIST, "Can not create FIFO %s", FIFO_PATH);
+  fifo_fd = open(FIFO_PATH, O_RDONLY | O_NONBLOCK);
+  Assert(fifo_fd != -1, "Can not open FIFO %s", FIFO_PATH);
+  Log("Serial input is read from %s", FIFO_PATH);
+}
+#else
+static bool serial_rx_ready() { return false; }
+static uint8_t serial_dequeue() { panic("do not support read"); }
+void serial_rx_collect() {}
+#endif
 
 static void serial_putc(char ch) {
   MUXDEF(CONFIG_TARGET_AM, putch(ch), putc(ch, stderr));
@@ -34,7 +95,13 @@ static void serial_io_handler(uint32_t offset, int len, bool is_write) {
     /* We bind the serial port with the host stderr in NEMU. */
     case CH_OFFSET:
       if (is_write) serial_putc(serial_base[0]);
-      else panic("do not support read");
+      else serial_base[0] = serial_dequeue();
+      break;
+    case LSR_OFFSET:
+      if (!is_write) {
+        serial_base[LSR_OFFSET] = LSR_TX_READY | (serial_rx_ready() ? LSR_RX_READY : 0);
+        if (!serial_rx_ready()) idle_note_poll();
+      }
       break;
     default: panic("do not support offset = %d", offset);
   }
@@ -48,4 +115,10 @@ void init_serial() {
   add_mmio_map("serial", CONFIG_SERIAL_MMIO, serial_base, 8, serial_io_handler);
 #endif
 
+  IFDEF(CONFIG_SERIAL_INPUT_FIFO, init_fifo());
+#if defined(CONFIG_CHECKPOINT) && defined(CONFIG_SERIAL_INPUT_FIFO)
+  ckpt_add("serial queue", queue, sizeof(queue), NULL, NULL);
+  ckpt_add("serial front", &f, sizeof(f), NULL, NULL);
+  ckpt_add("serial rear", &r, sizeof(r), NULL, NULL);
+#endif
 }
@@ -15,6 +15,8 @@
 
 #include <device/map.h>
 #include <device/alarm.h>
+#include <device/intr.h>
+#include <cpu/idle.h>
 #include <utils.h>
 
 static uint32_t *rtc_port_base = NULL;
@@ -22,6 +24,7 @@ static uint32_t *rtc_port_base = NULL;
 static void rtc_io_handler(uint32_t offset, int len, bool is_write) {
   assert(offset == 0 || offset == 4);
   if (!is_write && offset == 4) {
+    idle_note_poll();
     uint64_t us = get_time();
     rtc_port_base[0] = (uint32_t)us;
     rtc_port_base[1] = us >> 32;
@@ -31,7 +34,6 @@ static void rtc_io_handler(uint32_t offset, int len, bool is_write) {
 #ifndef CONFIG_TARGET_AM
 static void timer_intr() {
   if (nemu_state.state == NEMU_RUNNING) {
-    extern void dev_raise_intr();
     dev_raise_intr();
   }
 }
@@ -14,6 +14,7 @@
 ***************************************************************************************/
 
 #include <cpu/cpu.h>
+#include <checkpoint.h>
 
 void sdb_mainloop();
 
@@ -23,5 +24,6 @@ void engine_start() {
 #else
   /* Receive commands from user. */
   sdb_mainloop();
+  IFDEF(CONFIG_CHECKPOINT, ckpt_finish());
 #endif
 }
@@ -60,6 +60,7 @@ static int decode_exec(Decode *s) {
   INSTPAT("0010100110 ???????????? ????? ?????"   , st.w     , 2RI12 , Mw(src1 + imm, 4, R(rd)));
 
   INSTPAT("0000 0000 0010 10100 ????? ????? ?????", break    , N     , NEMUTRAP(s->pc, R(4))); // R(4) is $a0
+  INSTPAT("0000 0110 0100 10001 ????? ????? ?????", idle     , N     , cpu_wfi());
   INSTPAT("????????????????? ????? ????? ?????"   , inv      , N     , INV(s->pc));
   INSTPAT_END();
 
@@ -72,3 +73,32 @@ int isa_exec_once(Decode *s) {
   s->isa.inst = inst_fetch(&s->snpc, 4);
   return decode_exec(s);
 }
+
+int isa_inst_class(Decode *s) {
+  int cls = INST_OTHER;
+
+#undef INSTPAT_MATCH
+#undef INSTPAT_PERF
+#define INSTPAT_MATCH(s, class) { cls = concat(INST_, class); }
+#define INSTPAT_PERF(pattern, ...)
+
+  INSTPAT_START(class);
+  INSTPAT("010101 ???????????????? ??????????"    , CALL);   // bl
+  INSTPAT("010011 ???????????????? ????? 00001"   , CALL);   // jirl $ra
+  INSTPAT("010011 ???????????????? 00001 00000"   , RET);    // jirl $zero, $ra
+  INSTPAT("010011 ???????????????? ????? ?????"   , JUMP);   // jirl
+  INSTPAT("010100 ???????????????? ??????????"    , JUMP);   // b
+  INSTPAT("01000? ???????????????? ??????????"    , BRANCH); // beqz, bnez
+  INSTPAT("01011? ???????????????? ??????????"    , BRANCH); // beq, bne
+  INSTPAT("0110?? ???????????????? ??????????"    , BRANCH); // blt, bge, bltu, bgeu
+  INSTPAT("00101000 ?? ???????????? ????? ?????"  , LOAD);   // ld.b, ld.h, ld.w
+  INSTPAT("00101010 0? ???????????? ????? ?????"  , LOAD);   // ld.bu, ld.hu
+  INSTPAT("00101001 ?? ???????????? ????? ?????"  , STORE);  // st.b, st.h, st.w
+  INSTPAT("00000000000111 0?? ????? ????? ?????"  , MULDIV); // mul.w, mulh.w, mulh.wu
+  INSTPAT("00000000001000 0?? ????? ????? ?????"  , MULDIV); // div.w, mod.w, div.wu, mod.wu
+  INSTPAT("00000000001010 1?? ????? ????? ?????"  , SYSTEM); // break, syscall
+  INSTPAT("000001 ???????????????? ??????????"    , SYSTEM); // csr, cache, tlb, idle, ertn
+  INSTPAT_END(class);
+
+  return cls;
+}
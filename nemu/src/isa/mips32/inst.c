@@ -62,6 +62,7 @@ static int decode_exec(Decode *s) {
   INSTPAT("101011 ????? ????? ????? ????? ??????", sw     , I, Mw(src1 + imm, 4, R(rd)));
 
   INSTPAT("011100 ????? ????? ????? ????? 111111", sdbbp  , N, NEMUTRAP(s->pc, R(2))); // R(2) is $v0;
+  INSTPAT("010000 1???? ????? ????? ????? 100000", wait   , N, cpu_wfi());
   INSTPAT("?????? ????? ????? ????? ????? ??????", inv    , N, INV(s->pc));
   INSTPAT_END();
 
@@ -74,3 +75,32 @@ int isa_exec_once(Decode *s) {
   s->isa.inst = inst_fetch(&s->snpc, 4);
   return decode_exec(s);
 }
+
+int isa_inst_class(Decode *s) {
+  int cls = INST_OTHER;
+
+#undef INSTPAT_MATCH
+#undef INSTPAT_PERF
+#define INSTPAT_MATCH(s, class) { cls = concat(INST_, class); }
+#define INSTPAT_PERF(pattern, ...)
+
+  INSTPAT_START(class);
+  INSTPAT("000011 ????? ????? ????? ????? ??????", CALL);   // jal
+  INSTPAT("000000 ????? ????? ????? ????? 001001", CALL);   // jalr
+  INSTPAT("000001 ????? 1000? ????? ????? ??????", CALL);   // bltzal, bgezal
+  INSTPAT("000000 11111 ????? ????? ????? 001000", RET);    // jr $ra
+  INSTPAT("000000 ????? ????? ????? ????? 001000", JUMP);   // jr
+  INSTPAT("000010 ????? ????? ????? ????? ??????", JUMP);   // j
+  INSTPAT("0001?? ????? ????? ????? ????? ??????", BRANCH); // beq, bne, blez, bgtz
+  INSTPAT("000001 ????? ????? ????? ????? ??????", BRANCH); // bltz, bgez
+  INSTPAT("100??? ????? ????? ????? ????? ??????", LOAD);
+  INSTPAT("101??? ????? ????? ????? ????? ??????", STORE);
+  INSTPAT("000000 ????? ????? ????? ????? 0110??", MULDIV); // mult, multu, div, divu
+  INSTPAT("011100 ????? ????? ????? ????? 000010", MULDIV); // mul
+  INSTPAT("000000 ????? ????? ????? ????? 00110?", SYSTEM); // syscall, break
+  INSTPAT("011100 ????? ????? ????? ????? 111111", SYSTEM); // sdbbp
+  INSTPAT("010000 ????? ????? ????? ????? ??????", SYSTEM); // cop0
+  INSTPAT_END(class);
+
+  return cls;
+}
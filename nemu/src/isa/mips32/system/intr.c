@@ -14,8 +14,11 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include <cpu/perf.h>
 
 word_t isa_raise_intr(word_t NO, vaddr_t epc) {
+  perf_count(nr_trap);
+
   /* TODO: Trigger an interrupt/exception with ``NO''.
    * Then return the address of the interrupt/exception vector.
    */
@@ -17,6 +17,8 @@
 #include <cpu/cpu.h>
 #include <cpu/ifetch.h>
 #include <cpu/decode.h>
+#include <cpu/timing.h>
+#include <cpu/difftest.h>
 
 #define R(i) gpr(i)
 #define Mr vaddr_read
@@ -63,7 +65,14 @@ static int decode_exec(Decode *s) {
   INSTPAT("??????? ????? ????? 100 ????? 00000 11", lbu    , I, R(rd) = Mr(src1 + imm, 1));
   INSTPAT("??????? ????? ????? 000 ????? 01000 11", sb     , S, Mw(src1 + imm, 1, src2));
 
+  // csrr rd, cycle/cycleh/mcycle/mcycleh, whose value REF can not reproduce
+  INSTPAT("1100000 00000 00000 010 ????? 11100 11", rdcycle  , N, R(rd) = get_cycle(); difftest_skip_ref());
+  INSTPAT("1100100 00000 00000 010 ????? 11100 11", rdcycleh , N, R(rd) = get_cycle() >> 32; difftest_skip_ref());
+  INSTPAT("1011000 00000 00000 010 ????? 11100 11", rdmcycle , N, R(rd) = get_cycle(); difftest_skip_ref());
+  INSTPAT("1011100 00000 00000 010 ????? 11100 11", rdmcycleh, N, R(rd) = get_cycle() >> 32; difftest_skip_ref());
+
   INSTPAT("0000000 00001 00000 000 00000 11100 11", ebreak , N, NEMUTRAP(s->pc, R(10))); // R(10) is $a0
+  INSTPAT("0001000 00101 00000 000 00000 11100 11", wfi    , N, cpu_wfi());
   INSTPAT("??????? ????? ????? ??? ????? ????? ??", inv    , N, INV(s->pc));
   INSTPAT_END();
 
@@ -76,3 +85,31 @@ int isa_exec_once(Decode *s) {
   s->isa.inst = inst_fetch(&s->snpc, 4);
   return decode_exec(s);
 }
+
+int isa_inst_class(Decode *s) {
+  int cls = INST_OTHER;
+
+#undef INSTPAT_MATCH
+#undef INSTPAT_PERF
+#define INSTPAT_MATCH(s, class) { cls = concat(INST_, class); }
+#define INSTPAT_PERF(pattern, ...)
+
+  // x1 ($ra) and x5 ($t0) are link registers
+  INSTPAT_START(class);
+  INSTPAT("??????? ????? ????? ??? 00001 11011 11", CALL);   // jal ra
+  INSTPAT("??????? ????? ????? ??? 00101 11011 11", CALL);   // jal t0
+  INSTPAT("??????? ????? ????? ??? ????? 11011 11", JUMP);   // jal
+  INSTPAT("??????? ????? ????? 000 00001 11001 11", CALL);   // jalr ra
+  INSTPAT("??????? ????? ????? 000 00101 11001 11", CALL);   // jalr t0
+  INSTPAT("??????? ????? 00001 000 00000 11001 11", RET);    // jalr zero, ra
+  INSTPAT("??????? ????? 00101 000 00000 11001 11", RET);    // jalr zero, t0
+  INSTPAT("??????? ????? ????? 000 ????? 11001 11", JUMP);   // jalr
+  INSTPAT("??????? ????? ????? ??? ????? 11000 11", BRANCH);
+  INSTPAT("??????? ????? ????? ??? ????? 00000 11", LOAD);
+  INSTPAT("??????? ????? ????? ??? ????? 01000 11", STORE);
+  INSTPAT("0000001 ????? ????? ??? ????? 01100 11", MULDIV);
+  INSTPAT("??????? ????? ????? ??? ????? 11100 11", SYSTEM);
+  INSTPAT_END(class);
+
+  return cls;
+}
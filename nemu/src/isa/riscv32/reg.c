@@ -59,3 +59,20 @@ word_t isa_reg_str2val(const char *s, bool *success)
   *success = false;
   return 0;
 }
+
+word_t *isa_reg_str2ptr(const char *s)
+{
+  if (strcmp(s, "pc") == 0)
+  {
+    return &cpu.pc;
+  }
+
+  for (int i = 0; i < ARRLEN(cpu.gpr); i++)
+  {
+    if (strcmp(regs[i], s) == 0)
+    {
+      return &cpu.gpr[i];
+    }
+  }
+  return NULL;
+}
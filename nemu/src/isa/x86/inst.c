@@ -41,7 +41,7 @@ typedef union {
 } SIB;
 
 static word_t x86_inst_fetch(Decode *s, int len) {
-#if defined(CONFIG_ITRACE) || defined(CONFIG_IQUEUE)
+#if defined(CONFIG_ITRACE) || defined(CONFIG_IQUEUE) || defined(CONFIG_BTRACE) || defined(INST_CLASS_ENABLE)
   uint8_t *p = &s->isa.inst[s->snpc - s->pc];
   word_t ret = inst_fetch(&s->snpc, len);
   word_t ret_save = ret;
@@ -213,8 +213,44 @@ again:
   INSTPAT("1100 0110", mov,       I2E,  1, RMw(imm));
   INSTPAT("1100 0111", mov,       I2E,  0, RMw(imm));
   INSTPAT("1100 1100", nemu_trap, N,    0, NEMUTRAP(s->pc, cpu.eax));
+  INSTPAT("1111 0100", hlt,       N,    0, cpu_wfi());
   INSTPAT("???? ????", inv,       N,    0, INV(s->pc));
   INSTPAT_END();
 
   return 0;
 }
+
+int isa_inst_class(Decode *s) {
+  int cls = INST_OTHER;
+  uint8_t *p = s->isa.inst;
+  while (*p == 0x66) p ++; // skip the operand size prefix
+  uint8_t opcode = p[0];
+  ModR_M m = { .val = p[1] };
+  bool mem = (m.mod != 3);
+
+#undef INSTPAT_INST
+#undef INSTPAT_MATCH
+#undef INSTPAT_PERF
+#define INSTPAT_PERF(pattern, ...)
+#define INSTPAT_INST(s) opcode
+#define INSTPAT_MATCH(s, class, ...) { cls = concat(INST_, class); __VA_ARGS__; }
+
+  INSTPAT_START(class);
+  INSTPAT("0000 1111", OTHER,  if ((p[1] & 0xf0) == 0x80) cls = INST_BRANCH); // jcc rel32
+  INSTPAT("0111 ????", BRANCH);                                             // jcc rel8
+  INSTPAT("1110 1000", CALL);                                               // call rel32
+  INSTPAT("1100 001?", RET);                                                // ret, ret imm16
+  INSTPAT("1110 10?1", JUMP);                                               // jmp rel32, jmp rel8
+  INSTPAT("1111 1111", OTHER,  cls = (m.reg == 2 ? INST_CALL : m.reg == 4 ? INST_JUMP : INST_OTHER));
+  INSTPAT("1000 101?", OTHER,  if (mem) cls = INST_LOAD);                  // mov E2G
+  INSTPAT("1000 100?", OTHER,  if (mem) cls = INST_STORE);                 // mov G2E
+  INSTPAT("1100 011?", OTHER,  if (mem) cls = INST_STORE);                 // mov I2E
+  INSTPAT("1010 000?", LOAD);                                               // mov O2a
+  INSTPAT("1010 001?", STORE);                                              // mov a2O
+  INSTPAT("1111 011?", OTHER,  if (m.reg >= 4) cls = INST_MULDIV);         // mul, imul, div, idiv
+  INSTPAT("1100 1100", SYSTEM);                                             // nemu_trap
+  INSTPAT("1111 0100", SYSTEM);                                             // hlt
+  INSTPAT_END(class);
+
+  return cls;
+}
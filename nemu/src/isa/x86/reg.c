@@ -59,3 +59,7 @@ void isa_reg_display() {
 word_t isa_reg_str2val(const char *s, bool *success) {
   return 0;
 }
+
+word_t* isa_reg_str2ptr(const char *s) {
+  return NULL;
+}
@@ -14,9 +14,12 @@
 ***************************************************************************************/
 
 #include <isa.h>
+#include <cpu/perf.h>
 #include <memory/vaddr.h>
 
 word_t isa_raise_intr(word_t NO, vaddr_t ret_addr) {
+  perf_count(nr_trap);
+
   /* TODO: Trigger an interrupt/exception with ``NO''.
    * That is, use ``NO'' to index the IDT.
    */
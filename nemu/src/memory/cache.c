@@ -0,0 +1,192 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <memory/cache.h>
+#include <memory/paddr.h>
+#include <checkpoint.h>
+
+#ifdef CONFIG_CACHE_SIM
+
+#define LINE_SIZE CONFIG_CACHE_LINE_SIZE
+#define WRITE_BACK MUXDEF(CONFIG_CACHE_WRITE_BACK, true, false)
+
+// each line takes 8 bytes: (line address << 2) | DIRTY | VALID
+#define VALID 1ull
+#define DIRTY 2ull
+#define NO_VICTIM UINT64_MAX
+
+typedef struct {
+  const char *name;
+  uint64_t *line;  // [nr_set][assoc], a set is ordered from the newest line
+  uint64_t *last;  // the line accessed last time, to skip the search
+  uint32_t nr_set, assoc;
+  uint64_t nr_access, nr_miss, nr_writeback;
+} Cache;
+
+static Cache l1i, l1d, l2;
+static uint64_t miss_cycles = 0;
+
+static void init_one(Cache *c, const char *name, int size_kb, int assoc) {
+  c->name = name;
+  c->assoc = assoc;
+  c->nr_set = size_kb * 1024 / LINE_SIZE / assoc;
+  Assert(c->nr_set > 0 && (c->nr_set & (c->nr_set - 1)) == 0,
+      "the number of sets of %s must be a power of 2", name);
+  c->line = calloc(c->nr_set * assoc, sizeof(uint64_t));
+  assert(c->line);
+  c->last = c->line;
+}
+
+void init_cache() {
+  static_assert((LINE_SIZE & (LINE_SIZE - 1)) == 0, "line size must be a power of 2");
+  init_one(&l1i, "L1I", CONFIG_L1I_SIZE, CONFIG_L1I_ASSOC);
+  init_one(&l1d, "L1D", CONFIG_L1D_SIZE, CONFIG_L1D_ASSOC);
+  init_one(&l2,  "L2",  CONFIG_L2_SIZE,  CONFIG_L2_ASSOC);
+}
+
+#ifdef CONFIG_CACHE_REPL_RANDOM
+static uint32_t seed = 1;
+#endif
+
+static inline uint32_t choose_victim(Cache *c) {
+#ifdef CONFIG_CACHE_REPL_RANDOM
+  seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+  return seed % c->assoc;
+#else
+  return c->assoc - 1; // the oldest one
+#endif
+}
+
+/* Look up a line. On a miss, the line is filled if `alloc` is true, and
+ * the address of the dirty line evicted is returned through `victim`. */
+static bool lookup(Cache *c, uint64_t la, bool is_write, bool alloc, uint64_t *victim) {
+  uint64_t key = (la << 2) | VALID;
+  uint64_t dirty = (WRITE_BACK && is_write ? DIRTY : 0);
+  *victim = NO_VICTIM;
+  c->nr_access ++;
+
+  if (likely((*c->last & ~DIRTY) == key)) { *c->last |= dirty; return true; }
+
+  uint64_t *set = &c->line[(la & (c->nr_set - 1)) * c->assoc];
+  for (int i = 0; i < c->assoc; i ++) {
+    if ((set[i] & ~DIRTY) == key) {
+      uint64_t l = set[i] | dirty;
+#ifdef CONFIG_CACHE_REPL_LRU
+      memmove(set + 1, set, sizeof(set[0]) * i);
+      set[0] = l;
+      c->last = set;
+#else
+      set[i] = l;
+      c->last = &set[i];
+#endif
+      return true;
+    }
+  }
+
+  c->nr_miss ++;
+  if (!alloc) return false;
+  uint32_t w = choose_victim(c);
+  if ((set[w] & (VALID | DIRTY)) == (VALID | DIRTY)) {
+    *victim = set[w] >> 2;
+    c->nr_writeback ++;
+  }
+#ifdef CONFIG_CACHE_REPL_RANDOM
+  set[w] = key | dirty;
+  c->last = &set[w];
+#else
+  memmove(set + 1, set, sizeof(set[0]) * w);
+  set[0] = key | dirty;
+  c->last = set;
+#endif
+  return false;
+}
+
+// write back and write through are assumed to be buffered, so they do not stall
+static uint32_t l2_access(uint64_t la, bool is_write) {
+  uint64_t victim;
+  bool hit = lookup(&l2, la, is_write, WRITE_BACK || !is_write, &victim);
+  if (is_write) return 0;
+  return CONFIG_CACHE_L2_LATENCY + (hit ? 0 : CONFIG_CACHE_MEM_LATENCY);
+}
+
+static uint32_t l1_access(Cache *c, uint64_t la, bool is_write) {
+  uint64_t victim;
+  bool hit = lookup(c, la, is_write, WRITE_BACK || !is_write, &victim);
+  if (victim != NO_VICTIM) l2_access(victim, true);
+  if (!WRITE_BACK && is_write) { l2_access(la, true); return 0; }
+  return (hit ? 0 : l2_access(la, false));
+}
+
+static inline uint32_t cache_access(Cache *c, paddr_t addr, int len, bool is_write) {
+  if (!in_pmem(addr)) return 0; // devices are not cached
+  uint64_t first = addr / LINE_SIZE, last = ((uint64_t)addr + len - 1) / LINE_SIZE;
+  uint32_t cycles = l1_access(c, first, is_write);
+  if (unlikely(last != first)) cycles += l1_access(c, last, is_write);
+  miss_cycles += cycles;
+  return cycles;
+}
+
+#ifdef CONFIG_CHECKPOINT
+// `last' points into the lines of another run after they are loaded
+static void load_last() {
+  l1i.last = l1i.line;
+  l1d.last = l1d.line;
+  l2.last = l2.line;
+}
+
+void cache_add_ckpt() {
+  ckpt_add("L1I lines", l1i.line, sizeof(uint64_t) * l1i.nr_set * l1i.assoc, NULL, NULL);
+  ckpt_add("L1D lines", l1d.line, sizeof(uint64_t) * l1d.nr_set * l1d.assoc, NULL, NULL);
+  ckpt_add("L2 lines", l2.line, sizeof(uint64_t) * l2.nr_set * l2.assoc, NULL, load_last);
+  // the counters of a cache are adjacent
+  ckpt_add("L1I counters", &l1i.nr_access, sizeof(uint64_t) * 3, NULL, NULL);
+  ckpt_add("L1D counters", &l1d.nr_access, sizeof(uint64_t) * 3, NULL, NULL);
+  ckpt_add("L2 counters", &l2.nr_access, sizeof(uint64_t) * 3, NULL, NULL);
+  ckpt_add("cache miss cycles", &miss_cycles, sizeof(miss_cycles), NULL, NULL);
+  IFDEF(CONFIG_CACHE_REPL_RANDOM, ckpt_add("cache seed", &seed, sizeof(seed), NULL, NULL));
+}
+#endif
+
+uint32_t cache_ifetch(paddr_t addr, int len) { return cache_access(&l1i, addr, len, false); }
+uint32_t cache_read(paddr_t addr, int len) { return cache_access(&l1d, addr, len, false); }
+uint32_t cache_write(paddr_t addr, int len) { return cache_access(&l1d, addr, len, true); }
+
+static double hit_rate(Cache *c) {
+  return (c->nr_access == 0 ? 0 : 100.0 * (c->nr_access - c->nr_miss) / c->nr_access);
+}
+
+void cache_statistic() {
+  Cache *all[] = { &l1i, &l1d, &l2 };
+  for (int i = 0; i < ARRLEN(all); i ++) {
+    Cache *c = all[i];
+    Log("%-3s: %" PRIu64 " accesses, %" PRIu64 " misses, hit rate = %.2f%%, %" PRIu64 " writebacks",
+        c->name, c->nr_access, c->nr_miss, hit_rate(c), c->nr_writeback);
+  }
+  Log("estimated cycles spent on cache misses = %" PRIu64, miss_cycles);
+}
+
+void cache_dump_json(FILE *fp) {
+  Cache *all[] = { &l1i, &l1d, &l2 };
+  fprintf(fp, "  \"cache\": {\n");
+  for (int i = 0; i < ARRLEN(all); i ++) {
+    Cache *c = all[i];
+    fprintf(fp, "    \"%s\": {\"access\": %" PRIu64 ", \"miss\": %" PRIu64 ", \"writeback\": %" PRIu64 "},\n",
+        c->name, c->nr_access, c->nr_miss, c->nr_writeback);
+  }
+  fprintf(fp, "    \"miss_cycles\": %" PRIu64 "\n  }", miss_cycles);
+}
+
+#endif
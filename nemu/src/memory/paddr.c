@@ -16,7 +16,14 @@
 #include <memory/host.h>
 #include <memory/paddr.h>
 #include <device/mmio.h>
+#include <memory/cache.h>
+#include <cpu/reverse.h>
+#include <cpu/difftest.h>
 #include <isa.h>
+#ifdef CONFIG_TARGET_SHARE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #if   defined(CONFIG_PMEM_MALLOC)
 static uint8_t *pmem = NULL;
@@ -27,13 +34,43 @@ static uint8_t pmem[CONFIG_MSIZE] PG_ALIGN = {};
 uint8_t* guest_to_host(paddr_t paddr) { return pmem + paddr - CONFIG_MBASE; }
 paddr_t host_to_guest(uint8_t *haddr) { return haddr - pmem + CONFIG_MBASE; }
 
+#ifdef CONFIG_TARGET_SHARE
+// the file is mapped private, so the pages stay shared with the owner of the
+// file until either side writes them, and the writes are not seen by the other
+void pmem_map(int fd) {
+  struct stat st;
+  int r = fstat(fd, &st);
+  assert(r == 0);
+  size_t size = (st.st_size < CONFIG_MSIZE ? st.st_size : CONFIG_MSIZE);
+  assert(size > 0);
+#if   defined(CONFIG_PMEM_MALLOC)
+  // keep the whole pmem contiguous, the part out of the file is anonymous
+  uint8_t *p = mmap(NULL, CONFIG_MSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  assert(p != MAP_FAILED);
+  free(pmem);
+  pmem = p;
+#endif
+  void *ret = mmap(pmem, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+  assert(ret == pmem);
+  Log("physical memory area [" FMT_PADDR ", " FMT_PADDR "] is mapped copy-on-write",
+      PMEM_LEFT, PMEM_LEFT + (paddr_t)size - 1);
+}
+#endif
+
 static word_t pmem_read(paddr_t addr, int len) {
   word_t ret = host_read(guest_to_host(addr), len);
   return ret;
 }
 
+#ifdef CONFIG_CHECKPOINT
+uint64_t pmem_dirty[PMEM_DIRTY_WORDS] = {};
+#endif
+
 static void pmem_write(paddr_t addr, int len, word_t data) {
+  IFDEF(CONFIG_REVERSE, rev_note_write(addr, len));
+  IFDEF(CONFIG_DIFFTEST, difftest_note_write(addr, len, data));
   host_write(guest_to_host(addr), len, data);
+  IFDEF(CONFIG_CHECKPOINT, pmem_mark_dirty(addr, len));
 }
 
 static void out_of_bound(paddr_t addr) {
@@ -47,10 +84,23 @@ void init_mem() {
   assert(pmem);
 #endif
   IFDEF(CONFIG_MEM_RANDOM, memset(pmem, rand(), CONFIG_MSIZE));
+  IFDEF(CONFIG_CACHE_SIM, init_cache());
   Log("physical memory area [" FMT_PADDR ", " FMT_PADDR "]", PMEM_LEFT, PMEM_RIGHT);
 }
 
 word_t paddr_read(paddr_t addr, int len) {
+  if (likely(in_pmem(addr))) {
+    word_t ret = pmem_read(addr, len);
+    MTRACE(addr, len, ret, false);
+    return ret;
+  }
+  IFDEF(CONFIG_DEVICE, return mmio_read(addr, len));
+  out_of_bound(addr);
+  return 0;
+}
+
+// instruction fetch is not traced by mtrace, since it is already in the trace
+word_t paddr_ifetch(paddr_t addr, int len) {
   if (likely(in_pmem(addr))) return pmem_read(addr, len);
   IFDEF(CONFIG_DEVICE, return mmio_read(addr, len));
   out_of_bound(addr);
@@ -58,7 +108,12 @@ word_t paddr_read(paddr_t addr, int len) {
 }
 
 void paddr_write(paddr_t addr, int len, word_t data) {
-  if (likely(in_pmem(addr))) { pmem_write(addr, len, data); return; }
+  if (likely(in_pmem(addr))) {
+    DATA_WATCH(addr, len, pmem_read(addr, len), data);
+    pmem_write(addr, len, data);
+    MTRACE(addr, len, data, true);
+    return;
+  }
   IFDEF(CONFIG_DEVICE, mmio_write(addr, len, data); return);
   out_of_bound(addr);
 }
@@ -15,15 +15,23 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <memory/cache.h>
+#include <cpu/perf.h>
+#include <cpu/timing.h>
 
 word_t vaddr_ifetch(vaddr_t addr, int len) {
-  return paddr_read(addr, len);
+  timing_add(TIMING_CACHE, cache_ifetch(addr, len));
+  return paddr_ifetch(addr, len);
 }
 
 word_t vaddr_read(vaddr_t addr, int len) {
+  perf_count(nr_load);
+  timing_add(TIMING_CACHE, cache_read(addr, len));
   return paddr_read(addr, len);
 }
 
 void vaddr_write(vaddr_t addr, int len, word_t data) {
+  perf_count(nr_store);
+  timing_add(TIMING_CACHE, cache_write(addr, len));
   paddr_write(addr, len, data);
 }
@@ -0,0 +1,418 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <checkpoint.h>
+#include <memory/paddr.h>
+#include <cpu/difftest.h>
+#include <cpu/reverse.h>
+#include <cpu/timing.h>
+#include <cpu/bpred.h>
+#include <memory/cache.h>
+
+#ifdef CONFIG_CHECKPOINT
+
+#include <zlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* A checkpoint is a gzip stream of the registered pieces of state. Each
+ * piece is stored as its non-zero pages, and a page filled with the same
+ * byte is stored as that byte, so a freshly booted guest with a large
+ * pmem only takes the pages it has touched, even with CONFIG_MEM_RANDOM. The last image
+ * loaded is kept decompressed in memory, so restoring it again and again
+ * only copies the pages. */
+
+#define CKPT_MAGIC "NEMUCKPT"
+#define CKPT_VERSION 1
+#define CKPT_PAGE 4096
+#define CKPT_END UINT32_MAX
+#define CKPT_FILL 0x80000000u // the page is filled with the next byte
+#define MAX_ENTRY 64
+#define MAX_PENDING 16
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t nr_entry;
+  char isa[16];
+} CkptHeader;
+
+typedef struct {
+  char name[32];
+  uint64_t size;
+} CkptEntryHeader;
+
+typedef struct {
+  const char *name;
+  void *addr;
+  size_t size;
+  void (*save)();
+  void (*load)();
+} CkptEntry;
+
+static CkptEntry entry[MAX_ENTRY] = {};
+static int nr_entry = 0;
+
+static struct {
+  pid_t pid;
+  char *file;
+} pending[MAX_PENDING] = {};
+static int nr_pending = 0;
+
+static const char *save_file = NULL;
+
+// where to find a page in the image
+typedef struct {
+  const uint8_t *data; // NULL if the page is filled with `fill'
+  uint8_t fill;
+} CkptPage;
+
+typedef struct {
+  CkptEntryHeader h;
+  CkptPage *page;
+} CkptImageEntry;
+
+// the last image loaded, indexed by pages
+static struct {
+  char *file;
+  struct stat st;
+  uint8_t *buf;
+  CkptImageEntry *entry;
+  uint32_t nr_entry;
+  // pmem is the same as the image except the pages marked dirty since
+  // then, so restoring it again only copies those pages
+  bool pmem_clean;
+} cache = {};
+
+extern uint64_t g_nr_guest_inst;
+static uint64_t uptime = 0;
+
+static void save_time() { uptime = get_time(); }
+static void load_time() { set_time(uptime); }
+
+void ckpt_add(const char *name, void *addr, size_t size, void (*save)(), void (*load)()) {
+  assert(nr_entry < MAX_ENTRY && strlen(name) < sizeof(((CkptEntryHeader *)0)->name));
+  entry[nr_entry ++] = (CkptEntry) { name, addr, size, save, load };
+}
+
+// length of page `pg' of a piece of `size' bytes
+static size_t page_len(size_t size, uint64_t pg) {
+  size_t off = pg * CKPT_PAGE;
+  return (size - off < CKPT_PAGE ? size - off : CKPT_PAGE);
+}
+
+// whether the page is filled with byte `b'
+static bool page_is_fill(const uint8_t *p, size_t len, uint8_t b) {
+  const uint64_t *q = (const uint64_t *)p;
+  uint64_t w = b * 0x0101010101010101ull;
+  size_t i;
+  for (i = 0; i < len / 8; i ++) {
+    if (q[i] != w) return false;
+  }
+  for (i *= 8; i < len; i ++) {
+    if (p[i] != b) return false;
+  }
+  return true;
+}
+
+static bool write_image(const char *file) {
+  char tmp[strlen(file) + 8];
+  sprintf(tmp, "%s.tmp", file);
+  // level 1 is several times faster than the default and good enough for pages
+  gzFile gz = gzopen(tmp, "wb1");
+  if (gz == NULL) return false;
+
+  CkptHeader h = { .magic = CKPT_MAGIC, .version = CKPT_VERSION, .nr_entry = nr_entry };
+  strncpy(h.isa, str(__GUEST_ISA__), sizeof(h.isa) - 1);
+  bool ok = gzwrite(gz, &h, sizeof(h)) == sizeof(h);
+
+  for (int i = 0; i < nr_entry && ok; i ++) {
+    CkptEntry *e = &entry[i];
+    if (e->save) e->save();
+    CkptEntryHeader eh = { .size = e->size };
+    strcpy(eh.name, e->name);
+    ok = gzwrite(gz, &eh, sizeof(eh)) == sizeof(eh);
+    for (uint32_t pg = 0; (uint64_t)pg * CKPT_PAGE < e->size && ok; pg ++) {
+      uint8_t *p = (uint8_t *)e->addr + (uint64_t)pg * CKPT_PAGE;
+      size_t len = page_len(e->size, pg);
+      if (page_is_fill(p, len, p[0])) {
+        if (p[0] == 0) continue;
+        uint32_t fill = pg | CKPT_FILL;
+        ok = gzwrite(gz, &fill, sizeof(fill)) == sizeof(fill) && gzwrite(gz, p, 1) == 1;
+        continue;
+      }
+      ok = gzwrite(gz, &pg, sizeof(pg)) == sizeof(pg) && gzwrite(gz, p, len) == len;
+    }
+    uint32_t end = CKPT_END;
+    ok = ok && gzwrite(gz, &end, sizeof(end)) == sizeof(end);
+  }
+
+  ok = (gzclose(gz) == Z_OK) && ok;
+  // readers never see a partial image
+  if (ok) ok = rename(tmp, file) == 0;
+  else unlink(tmp);
+  return ok;
+}
+
+static void reap(const char *wait_file) {
+  for (int i = 0; i < nr_pending; ) {
+    bool wait = (wait_file == NULL || strcmp(pending[i].file, wait_file) == 0);
+    int status;
+    pid_t ret = waitpid(pending[i].pid, &status, wait ? 0 : WNOHANG);
+    if (ret == 0) { i ++; continue; }
+    if (ret < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      printf("Failed to save checkpoint %s\n", pending[i].file);
+    }
+    free(pending[i].file);
+    pending[i] = pending[-- nr_pending];
+  }
+}
+
+bool ckpt_save(const char *file, bool background) {
+  reap(file);
+  if (background && nr_pending < MAX_PENDING) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+      // the child has a copy of the whole machine to write at its own pace
+      _exit(write_image(file) ? 0 : 1);
+    }
+    if (pid > 0) {
+      pending[nr_pending].pid = pid;
+      pending[nr_pending].file = strdup(file);
+      nr_pending ++;
+      printf("Saving checkpoint to %s in process %d\n", file, pid);
+      return true;
+    }
+    // save it in the foreground if fork() fails
+  }
+
+  bool ok = write_image(file);
+  if (ok) printf("Saved checkpoint to %s\n", file);
+  else printf("Failed to save checkpoint %s\n", file);
+  return ok;
+}
+
+static void free_cache() {
+  for (uint32_t i = 0; i < cache.nr_entry; i ++) free(cache.entry[i].page);
+  free(cache.entry);
+  free(cache.buf);
+  free(cache.file);
+  memset(&cache, 0, sizeof(cache));
+}
+
+static uint8_t *decompress(const char *file, size_t hint, size_t *size) {
+  gzFile gz = gzopen(file, "rb");
+  if (gz == NULL) return NULL;
+  gzbuffer(gz, 1 << 20);
+  size_t cap = hint * 4 + CKPT_PAGE;
+  uint8_t *buf = malloc(cap);
+  int n;
+  *size = 0;
+  while (buf != NULL && (n = gzread(gz, buf + *size, cap - *size)) > 0) {
+    *size += n;
+    if (*size == cap) buf = realloc(buf, (cap *= 2));
+  }
+  if (gzclose(gz) != Z_OK) { free(buf); return NULL; }
+  return buf;
+}
+
+#define TAKE(len) ({ \
+  if (p + (len) > end) { printf("Checkpoint %s is truncated\n", file); return false; } \
+  const uint8_t *_q = p; p += (len); _q; \
+})
+
+static bool index_image(const char *file, size_t size) {
+  const uint8_t *p = cache.buf, *end = cache.buf + size;
+  CkptHeader h;
+  memcpy(&h, TAKE(sizeof(h)), sizeof(h));
+  if (memcmp(h.magic, CKPT_MAGIC, sizeof(h.magic)) != 0 || h.version != CKPT_VERSION ||
+      strncmp(h.isa, str(__GUEST_ISA__), sizeof(h.isa)) != 0) {
+    printf("%s is not a checkpoint of this NEMU\n", file);
+    return false;
+  }
+
+  cache.entry = calloc(h.nr_entry, sizeof(CkptImageEntry));
+  for (uint32_t i = 0; i < h.nr_entry; i ++) {
+    CkptImageEntry *ie = &cache.entry[cache.nr_entry ++];
+    memcpy(&ie->h, TAKE(sizeof(ie->h)), sizeof(ie->h));
+    ie->h.name[sizeof(ie->h.name) - 1] = '\0';
+    // pages not in the image are zero
+    uint64_t nr_page = (ie->h.size + CKPT_PAGE - 1) / CKPT_PAGE;
+    ie->page = calloc(nr_page, sizeof(CkptPage));
+    while (true) {
+      uint32_t rec;
+      memcpy(&rec, TAKE(sizeof(rec)), sizeof(rec));
+      if (rec == CKPT_END) break;
+      uint32_t pg = rec & ~CKPT_FILL;
+      if (pg >= nr_page) {
+        printf("Checkpoint %s is corrupted\n", file);
+        return false;
+      }
+      if (rec & CKPT_FILL) ie->page[pg].fill = *TAKE(1);
+      else ie->page[pg].data = TAKE(page_len(ie->h.size, pg));
+    }
+  }
+  return true;
+}
+
+static bool read_image(const char *file) {
+  struct stat st;
+  if (stat(file, &st) != 0) return false;
+  if (cache.file != NULL && strcmp(cache.file, file) == 0 &&
+      st.st_mtim.tv_sec == cache.st.st_mtim.tv_sec && st.st_mtim.tv_nsec == cache.st.st_mtim.tv_nsec &&
+      st.st_size == cache.st.st_size && st.st_ino == cache.st.st_ino) {
+    return true;
+  }
+
+  free_cache();
+  size_t size;
+  cache.buf = decompress(file, st.st_size, &size);
+  if (cache.buf == NULL || !index_image(file, size)) {
+    free_cache();
+    return false;
+  }
+  cache.file = strdup(file);
+  cache.st = st;
+  return true;
+}
+
+static CkptEntry *find_entry(const char *name) {
+  for (int i = 0; i < nr_entry; i ++) {
+    if (strcmp(entry[i].name, name) == 0) return &entry[i];
+  }
+  return NULL;
+}
+
+static void restore_page(CkptEntry *e, CkptPage *pg, uint64_t idx) {
+  uint8_t *q = (uint8_t *)e->addr + idx * CKPT_PAGE;
+  size_t len = page_len(e->size, idx);
+  if (pg->data != NULL) memcpy(q, pg->data, len);
+  // skip the pages already filled, which is much cheaper than writing them
+  else if (!page_is_fill(q, len, pg->fill)) memset(q, pg->fill, len);
+}
+
+bool ckpt_load(const char *file) {
+  reap(file);
+  if (!read_image(file)) {
+    printf("Can not read checkpoint %s\n", file);
+    return false;
+  }
+
+  uint8_t *pmem = guest_to_host(CONFIG_MBASE);
+  bool pmem_clean = cache.pmem_clean;
+  cache.pmem_clean = false;
+  for (uint32_t i = 0; i < cache.nr_entry; i ++) {
+    CkptImageEntry *ie = &cache.entry[i];
+    CkptEntry *e = find_entry(ie->h.name);
+    if (e == NULL || e->size != ie->h.size) {
+      printf("Checkpoint %s has %s of %" PRIu64 " bytes which does not match this NEMU\n", file, ie->h.name, ie->h.size);
+      return false;
+    }
+
+    uint64_t nr_page = (e->size + CKPT_PAGE - 1) / CKPT_PAGE;
+    if (e->addr == pmem && pmem_clean) {
+      for (uint64_t w = 0; w < PMEM_DIRTY_WORDS; w ++) {
+        for (uint64_t bits = pmem_dirty[w]; bits != 0; bits &= bits - 1) {
+          uint64_t idx = w * 64 + __builtin_ctzll(bits);
+          restore_page(e, &ie->page[idx], idx);
+        }
+      }
+    } else {
+      for (uint64_t idx = 0; idx < nr_page; idx ++) restore_page(e, &ie->page[idx], idx);
+    }
+    if (e->load) e->load();
+  }
+  memset(pmem_dirty, 0, sizeof(pmem_dirty[0]) * PMEM_DIRTY_WORDS);
+  cache.pmem_clean = true;
+
+  // the program may continue even if it has ended before
+  nemu_state.state = NEMU_STOP;
+  ckpt_sync_ref();
+  // the history before is not the past of this machine any more
+  IFDEF(CONFIG_REVERSE, rev_reset());
+  return true;
+}
+
+void ckpt_sync_ref() {
+#ifdef CONFIG_DIFFTEST
+  if (ref_difftest_memcpy != NULL) {
+    IFDEF(CONFIG_DIFFTEST_ASYNC, difftest_async_drain());
+    ref_difftest_memcpy(CONFIG_MBASE, guest_to_host(CONFIG_MBASE), CONFIG_MSIZE, DIFFTEST_TO_REF);
+    ref_difftest_regcpy(&cpu, DIFFTEST_TO_REF);
+    IFDEF(CONFIG_DIFFTEST_BATCH, difftest_batch_reset());
+  }
+#endif
+}
+
+static bool is_pmem(CkptEntry *e) {
+  return e->addr == guest_to_host(CONFIG_MBASE);
+}
+
+size_t ckpt_state_size() {
+  size_t size = 0;
+  for (int i = 0; i < nr_entry; i ++) {
+    if (!is_pmem(&entry[i])) size += entry[i].size;
+  }
+  return size;
+}
+
+void ckpt_state_save(uint8_t *buf) {
+  for (int i = 0; i < nr_entry; i ++) {
+    CkptEntry *e = &entry[i];
+    if (is_pmem(e)) continue;
+    if (e->save) e->save();
+    memcpy(buf, e->addr, e->size);
+    buf += e->size;
+  }
+}
+
+void ckpt_state_load(const uint8_t *buf) {
+  for (int i = 0; i < nr_entry; i ++) {
+    CkptEntry *e = &entry[i];
+    if (is_pmem(e)) continue;
+    memcpy(e->addr, buf, e->size);
+    buf += e->size;
+    if (e->load) e->load();
+  }
+}
+
+bool init_ckpt(const char *load_file, const char *save) {
+  ckpt_add("cpu", &cpu, sizeof(cpu), NULL, NULL);
+  ckpt_add("pmem", guest_to_host(CONFIG_MBASE), CONFIG_MSIZE, NULL, NULL);
+  ckpt_add("time", &uptime, sizeof(uptime), save_time, load_time);
+  ckpt_add("guest inst", &g_nr_guest_inst, sizeof(g_nr_guest_inst), NULL, NULL);
+  // the models affect the cycles seen by the guest
+  IFDEF(CONFIG_TIMING, timing_add_ckpt());
+  IFDEF(CONFIG_CACHE_SIM, cache_add_ckpt());
+  IFDEF(CONFIG_BPRED, bpred_add_ckpt());
+  save_file = save;
+
+  if (load_file == NULL) return false;
+  Assert(ckpt_load(load_file), "Can not restore the machine from %s", load_file);
+  Log("Restored the machine from checkpoint %s, pc = " FMT_WORD, load_file, cpu.pc);
+  return true;
+}
+
+void ckpt_finish() {
+  if (save_file != NULL) ckpt_save(save_file, false);
+  reap(NULL);
+}
+
+#endif
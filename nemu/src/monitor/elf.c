@@ -0,0 +1,113 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+#include <elf.h>
+
+Symbol *symbol = NULL;
+int nr_symbol = 0;
+static int cap_symbol = 0;
+
+static void add_symbol(uint64_t addr, uint64_t size, const char *name) {
+  if (nr_symbol == cap_symbol) {
+    cap_symbol = (cap_symbol == 0 ? 256 : cap_symbol * 2);
+    symbol = realloc(symbol, sizeof(Symbol) * cap_symbol);
+    assert(symbol);
+  }
+  symbol[nr_symbol ++] = (Symbol) { .addr = addr, .size = size, .name = strdup(name) };
+}
+
+static int symbol_cmp(const void *a, const void *b) {
+  const Symbol *x = a, *y = b;
+  return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+#define in_file(off, len) ((uint64_t)(off) + (uint64_t)(len) <= (uint64_t)size)
+
+#define load_symtab(bits) do { \
+  Elf##bits##_Ehdr *eh = (void *)buf; \
+  Assert(in_file(eh->e_shoff, (uint64_t)eh->e_shnum * sizeof(Elf##bits##_Shdr)), \
+      "Broken section header table in '%s'", elf_file); \
+  Elf##bits##_Shdr *sh = (void *)(buf + eh->e_shoff); \
+  for (int i = 0; i < eh->e_shnum; i ++) { \
+    if (sh[i].sh_type != SHT_SYMTAB) continue; \
+    Elf##bits##_Shdr *strsh = &sh[sh[i].sh_link]; \
+    Assert(sh[i].sh_link < eh->e_shnum && in_file(sh[i].sh_offset, sh[i].sh_size) && \
+        in_file(strsh->sh_offset, strsh->sh_size), "Broken symbol table in '%s'", elf_file); \
+    Elf##bits##_Sym *sym = (void *)(buf + sh[i].sh_offset); \
+    const char *strtab = (char *)buf + strsh->sh_offset; \
+    int n = sh[i].sh_size / sizeof(*sym); \
+    for (int j = 0; j < n; j ++) { \
+      if (ELF##bits##_ST_TYPE(sym[j].st_info) != STT_FUNC || sym[j].st_shndx == SHN_UNDEF) continue; \
+      if (sym[j].st_name >= strsh->sh_size) continue; \
+      add_symbol(sym[j].st_value, sym[j].st_size, strtab + sym[j].st_name); \
+    } \
+  } \
+} while (0)
+
+void init_elf(const char *elf_file) {
+  if (elf_file == NULL) return;
+
+  FILE *fp = fopen(elf_file, "rb");
+  Assert(fp, "Can not open '%s'", elf_file);
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  uint8_t *buf = malloc(size);
+  assert(buf);
+  int ret = fread(buf, size, 1, fp);
+  assert(ret == 1);
+  fclose(fp);
+
+  Assert(size >= EI_NIDENT && memcmp(buf, ELFMAG, SELFMAG) == 0, "'%s' is not an ELF file", elf_file);
+  if (buf[EI_CLASS] == ELFCLASS32) {
+    Assert(in_file(0, sizeof(Elf32_Ehdr)), "'%s' is too short", elf_file);
+    load_symtab(32);
+  } else {
+    Assert(in_file(0, sizeof(Elf64_Ehdr)), "'%s' is too short", elf_file);
+    load_symtab(64);
+  }
+  free(buf);
+
+  // sort symbols by address, and drop aliases at the same address
+  qsort(symbol, nr_symbol, sizeof(Symbol), symbol_cmp);
+  int n = 0;
+  for (int i = 0; i < nr_symbol; i ++) {
+    if (n > 0 && symbol[n - 1].addr == symbol[i].addr) {
+      if (symbol[n - 1].size == 0) symbol[n - 1].size = symbol[i].size;
+      free(symbol[i].name);
+      continue;
+    }
+    symbol[n ++] = symbol[i];
+  }
+  nr_symbol = n;
+  Log("Read %d function symbols from %s", nr_symbol, elf_file);
+}
+
+// return the index of the function containing addr, or -1 if there is none
+int symbol_find(vaddr_t addr) {
+  int l = 0, r = nr_symbol;
+  while (l < r) {
+    int mid = (l + r) / 2;
+    if (symbol[mid].addr <= addr) l = mid + 1;
+    else r = mid;
+  }
+  int i = l - 1;
+  if (i < 0) return -1;
+  // a function without size is considered to end at the next one
+  word_t size = symbol[i].size;
+  return (size == 0 || addr - symbol[i].addr < size ? i : -1);
+}
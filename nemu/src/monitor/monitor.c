@@ -15,14 +15,20 @@
 
 #include <isa.h>
 #include <memory/paddr.h>
+#include <checkpoint.h>
+#include <cpu/reverse.h>
 
 void init_rand();
 void init_log(const char *log_file);
+void init_btrace(const char *btrace_file);
+void init_mtrace(const char *range_str, int sample_rate);
+void init_elf(const char *elf_file);
+void init_ftrace(const char *file);
+void init_perf(const char *file);
 void init_mem();
 void init_difftest(char *ref_so_file, long img_size, int port);
 void init_device();
 void init_sdb();
-void init_disasm();
 
 static void welcome() {
   Log("Trace: %s", MUXDEF(CONFIG_TRACE, ANSI_FMT("ON", ANSI_FG_GREEN), ANSI_FMT("OFF", ANSI_FG_RED)));
@@ -38,9 +44,20 @@ static void welcome() {
 #include <getopt.h>
 
 void sdb_set_batch_mode();
+void sdb_set_script(char *file);
+void sdb_set_json_mode();
+void sdb_set_gdb(char *target);
 
 static char *log_file = NULL;
 static char *diff_so_file = NULL;
+static char *btrace_file = NULL;
+static char *mtrace_range = NULL;
+static int mtrace_sample = 1;
+static char *elf_file = NULL;
+static char *ftrace_file = NULL;
+static char *perf_file = NULL;
+static char *ckpt_load_file = NULL;
+static char *ckpt_save_file = NULL;
 static char *img_file = NULL;
 static int difftest_port = 1234;
 
@@ -72,16 +89,38 @@ static int parse_args(int argc, char *argv[]) {
     {"log"      , required_argument, NULL, 'l'},
     {"diff"     , required_argument, NULL, 'd'},
     {"port"     , required_argument, NULL, 'p'},
+    {"btrace"   , required_argument, NULL, 't'},
+    {"mtrace"   , required_argument, NULL, 'm'},
+    {"mtrace-sample", required_argument, NULL, 'S'},
+    {"elf"      , required_argument, NULL, 'e'},
+    {"ftrace"   , required_argument, NULL, 'f'},
+    {"perf"     , required_argument, NULL, 'P'},
+    {"script"   , required_argument, NULL, 's'},
+    {"json"     , no_argument      , NULL, 'j'},
+    {"gdb"      , required_argument, NULL, 'g'},
+    {"load"     , required_argument, NULL, 'L'},
+    {"save"     , required_argument, NULL, 'V'},
     {"help"     , no_argument      , NULL, 'h'},
     {0          , 0                , NULL,  0 },
   };
   int o;
-  while ( (o = getopt_long(argc, argv, "-bhl:d:p:", table, NULL)) != -1) {
+  while ( (o = getopt_long(argc, argv, "-bhjl:d:p:t:m:e:f:s:g:", table, NULL)) != -1) {
     switch (o) {
       case 'b': sdb_set_batch_mode(); break;
       case 'p': sscanf(optarg, "%d", &difftest_port); break;
       case 'l': log_file = optarg; break;
       case 'd': diff_so_file = optarg; break;
+      case 't': btrace_file = optarg; break;
+      case 'm': mtrace_range = optarg; break;
+      case 'S': sscanf(optarg, "%d", &mtrace_sample); break;
+      case 'e': elf_file = optarg; break;
+      case 'f': ftrace_file = optarg; break;
+      case 'P': perf_file = optarg; break;
+      case 's': sdb_set_script(optarg); break;
+      case 'j': sdb_set_json_mode(); break;
+      case 'g': sdb_set_gdb(optarg); break;
+      case 'L': ckpt_load_file = optarg; break;
+      case 'V': ckpt_save_file = optarg; break;
       case 1: img_file = optarg; return 0;
       default:
         printf("Usage: %s [OPTION...] IMAGE [args]\n\n", argv[0]);
@@ -89,6 +128,17 @@ static int parse_args(int argc, char *argv[]) {
         printf("\t-l,--log=FILE           output log to FILE\n");
         printf("\t-d,--diff=REF_SO        run DiffTest with reference REF_SO\n");
         printf("\t-p,--port=PORT          run DiffTest with port PORT\n");
+        printf("\t-t,--btrace=FILE        output binary execution trace to FILE\n");
+        printf("\t-m,--mtrace=LO-HI,...   also trace memory accesses in [LO, HI) into the binary trace\n");
+        printf("\t--mtrace-sample=N       only trace 1 in N of these memory accesses\n");
+        printf("\t-e,--elf=FILE           read function symbols from the ELF FILE\n");
+        printf("\t-f,--ftrace=FILE        output folded call stacks to FILE on exit\n");
+        printf("\t--perf=FILE             output performance counters to FILE as JSON on exit\n");
+        printf("\t-s,--script=FILE        run sdb commands from FILE instead of the prompt\n");
+        printf("\t-j,--json               report each scripted command as a line of JSON\n");
+        printf("\t-g,--gdb=PORT|PATH      serve gdb on localhost:PORT or the UNIX socket PATH\n");
+        printf("\t--load=FILE             restore the machine from the checkpoint FILE\n");
+        printf("\t--save=FILE             save the machine to the checkpoint FILE on exit\n");
         printf("\n");
         exit(0);
     }
@@ -108,6 +158,10 @@ void init_monitor(int argc, char *argv[]) {
   /* Open the log file. */
   init_log(log_file);
 
+  /* Open the binary trace file. */
+  IFDEF(CONFIG_BTRACE, init_btrace(btrace_file));
+  IFDEF(CONFIG_MTRACE, init_mtrace(mtrace_range, mtrace_sample));
+
   /* Initialize memory. */
   init_mem();
 
@@ -120,14 +174,27 @@ void init_monitor(int argc, char *argv[]) {
   /* Load the image to memory. This will overwrite the built-in image. */
   long img_size = load_img();
 
+  /* Read symbols of the image. */
+  init_elf(elf_file);
+  IFDEF(CONFIG_FTRACE, init_ftrace(ftrace_file));
+  IFDEF(CONFIG_PERF, init_perf(perf_file));
+
+  /* Restore the machine from a checkpoint. DiffTest then copies the whole memory. */
+#ifdef CONFIG_CHECKPOINT
+  if (init_ckpt(ckpt_load_file, ckpt_save_file)) img_size = CONFIG_MSIZE - (RESET_VECTOR - CONFIG_MBASE);
+#else
+  Assert(ckpt_load_file == NULL && ckpt_save_file == NULL, "Checkpoints are not enabled in menuconfig");
+#endif
+
+  /* Start recording the history for reverse execution. */
+  IFDEF(CONFIG_REVERSE, rev_reset());
+
   /* Initialize differential testing. */
   init_difftest(diff_so_file, img_size, difftest_port);
 
   /* Initialize the simple debugger. */
   init_sdb();
 
-  IFDEF(CONFIG_ITRACE, init_disasm());
-
   /* Display welcome message. */
   welcome();
 }
@@ -0,0 +1,300 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <isa.h>
+#include <cpu/reverse.h>
+#include "sdb.h"
+
+/* Breakpoints are kept in a chained hash table indexed by pc. cpu-exec
+ * only looks it up when there is some breakpoint, so execution runs at
+ * full speed until a breakpoint pc is reached. */
+#define NR_BUCKET 1024
+#define BUCKET(pc) ((((pc) >> 2) ^ ((pc) >> 12)) & (NR_BUCKET - 1))
+
+typedef struct breakpoint
+{
+  int NO;
+  vaddr_t pc;
+  bool temp;     // deleted after it stops the execution
+  int ignore;    // number of hits to ignore
+  uint64_t hit;
+  char cond[128];
+  ExprCode code; // compiled cond, len == 0 if there is no condition
+  struct breakpoint *next;  // list of all breakpoints
+  struct breakpoint *hnext; // list in the same bucket
+} BP;
+
+static BP *bucket[NR_BUCKET] = {};
+static BP *bp_head = NULL;
+int nr_breakpoint = 0;
+static bool bp_stopped = false;
+
+static BP *find_breakpoint(int no)
+{
+  for (BP *bp = bp_head; bp != NULL; bp = bp->next)
+  {
+    if (bp->NO == no)
+    {
+      return bp;
+    }
+  }
+  return NULL;
+}
+
+static void free_breakpoint(BP *bp)
+{
+  BP **pp;
+  for (pp = &bucket[BUCKET(bp->pc)]; *pp != bp; pp = &(*pp)->hnext)
+    ;
+  *pp = bp->hnext;
+  for (pp = &bp_head; *pp != bp; pp = &(*pp)->next)
+    ;
+  *pp = bp->next;
+  expr_free(&bp->code);
+  free(bp);
+  nr_breakpoint--;
+}
+
+bool delete_breakpoint(int no)
+{
+  BP *bp = find_breakpoint(no);
+  if (bp == NULL)
+  {
+    return false;
+  }
+  free_breakpoint(bp);
+  printf("Breakpoint %d deleted.\n", no);
+  return true;
+}
+
+// an empty cond removes the condition
+static bool set_cond(BP *bp, char *cond)
+{
+  ExprCode code = {};
+  if (cond != NULL && *cond != '\0')
+  {
+    if (strlen(cond) >= sizeof(bp->cond))
+    {
+      printf("Error: Condition is too long.\n");
+      return false;
+    }
+    if (!expr_compile(cond, &code))
+    {
+      printf("Error: Invalid condition.\n");
+      return false;
+    }
+  }
+  expr_free(&bp->code);
+  bp->code = code;
+  strcpy(bp->cond, (code.len == 0 ? "" : cond));
+  return true;
+}
+
+// called by cpu-exec before the instruction at pc is executed
+bool check_breakpoint(vaddr_t pc)
+{
+  bool stop = false;
+  BP *bp = bucket[BUCKET(pc)];
+  while (bp != NULL)
+  {
+    BP *next = bp->hnext;
+    if (bp->pc == pc)
+    {
+      bool success = true;
+      // a condition which fails to evaluate also stops the execution
+      if (bp->code.len != 0 && expr_eval(&bp->code, &success) == 0 && success)
+      {
+        bp = next;
+        continue;
+      }
+      // the history is only looked through when replaying, which leaves
+      // the counts and the temporary breakpoints alone
+      if (!rev_live())
+      {
+        stop |= (bp->ignore == 0);
+        bp = next;
+        continue;
+      }
+      bp->hit++;
+      if (bp->ignore > 0)
+      {
+        bp->ignore--;
+      }
+      else
+      {
+        printf("%s %d at pc = " FMT_WORD ", hit %" PRIu64 " time%s\n", (bp->temp ? "Temporary breakpoint" : "Breakpoint"),
+               bp->NO, pc, bp->hit, (bp->hit == 1 ? "" : "s"));
+        if (bp->temp)
+        {
+          free_breakpoint(bp);
+        }
+        stop = true;
+      }
+    }
+    bp = next;
+  }
+  bp_stopped |= stop;
+  return stop;
+}
+
+static void insert_breakpoint(BP *bp, vaddr_t pc, bool temp)
+{
+  bp->NO = new_sdb_no();
+  bp->pc = pc;
+  bp->temp = temp;
+  bp->next = bp_head;
+  bp_head = bp;
+  bp->hnext = bucket[BUCKET(pc)];
+  bucket[BUCKET(pc)] = bp;
+  nr_breakpoint++;
+
+  printf("%s %d at pc = " FMT_WORD "\n", (temp ? "Temporary breakpoint" : "Breakpoint"), bp->NO, pc);
+}
+
+// the gdb stub refers to breakpoints by pc instead of their numbers
+int add_breakpoint(vaddr_t pc)
+{
+  BP *bp = calloc(1, sizeof(BP));
+  assert(bp);
+  insert_breakpoint(bp, pc, false);
+  return bp->NO;
+}
+
+bool delete_breakpoint_at(vaddr_t pc)
+{
+  for (BP *bp = bucket[BUCKET(pc)]; bp != NULL; bp = bp->hnext)
+  {
+    if (bp->pc == pc)
+    {
+      return delete_breakpoint(bp->NO);
+    }
+  }
+  return false;
+}
+
+// whether some breakpoint has stopped the execution since the last call
+bool breakpoint_hit()
+{
+  bool hit = bp_stopped;
+  bp_stopped = false;
+  return hit;
+}
+
+static int set_breakpoint(char *args, bool temp)
+{
+  // b [EXPR] [if COND]
+  char *cond = NULL;
+  if (args != NULL)
+  {
+    char *p = strstr(args, "if ");
+    if (p != NULL && (p == args || p[-1] == ' '))
+    {
+      *p = '\0';
+      cond = p + 3;
+    }
+  }
+
+  vaddr_t pc = cpu.pc;
+  if (args != NULL && strspn(args, " ") != strlen(args))
+  {
+    bool success;
+    pc = expr(args, &success);
+    if (!success)
+    {
+      printf("Error: Invalid expression.\n");
+      return 0;
+    }
+  }
+
+  BP *bp = calloc(1, sizeof(BP));
+  assert(bp);
+  if (!set_cond(bp, cond))
+  {
+    free(bp);
+    return 0;
+  }
+  insert_breakpoint(bp, pc, temp);
+  return 0;
+}
+
+int cmd_b(char *args)
+{
+  return set_breakpoint(args, false);
+}
+
+int cmd_tb(char *args)
+{
+  return set_breakpoint(args, true);
+}
+
+int cmd_ignore(char *args)
+{
+  char *arg_no = strtok(args, " ");
+  char *arg_count = strtok(NULL, " ");
+  if (arg_no == NULL || arg_count == NULL)
+  {
+    printf("Usage: ignore N COUNT\n");
+    return 0;
+  }
+
+  BP *bp = find_breakpoint(atoi(arg_no));
+  if (bp == NULL)
+  {
+    printf("Breakpoint %s not found.\n", arg_no);
+    return 0;
+  }
+  bp->ignore = atoi(arg_count);
+  printf("Will ignore next %d crossings of breakpoint %d.\n", bp->ignore, bp->NO);
+  return 0;
+}
+
+int cmd_cond(char *args)
+{
+  char *arg_no = strtok(args, " ");
+  char *arg_cond = strtok(NULL, "");
+  if (arg_no == NULL)
+  {
+    printf("Usage: cond N [COND]\n");
+    return 0;
+  }
+
+  BP *bp = find_breakpoint(atoi(arg_no));
+  if (bp == NULL)
+  {
+    printf("Breakpoint %s not found.\n", arg_no);
+    return 0;
+  }
+  if (set_cond(bp, arg_cond))
+  {
+    printf("Breakpoint %d %s.\n", bp->NO, (bp->code.len == 0 ? "is now unconditional" : "condition set"));
+  }
+  return 0;
+}
+
+void list_breakpoint()
+{
+  if (bp_head == NULL)
+  {
+    printf("No breakpoints.\n");
+    return;
+  }
+
+  printf("%-8s %-5s %-12s %-8s %-8s %s\n", "NO", "Temp", "PC", "Hit", "Ignore", "Cond");
+  for (BP *bp = bp_head; bp != NULL; bp = bp->next)
+  {
+    printf("%-8d %-5s " FMT_WORD "   %-8" PRIu64 " %-8d %s\n", bp->NO, (bp->temp ? "y" : "n"),
+           bp->pc, bp->hit, bp->ignore, bp->cond);
+  }
+}
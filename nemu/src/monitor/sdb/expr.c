@@ -1,301 +1,559 @@
 /***************************************************************************************
- * Copyright (c) 2014-2024 Zihao Yu, Nanjing University
- *
- * NEMU is licensed under Mulan PSL v2.
- * You can use this software according to the terms and conditions of the Mulan PSL v2.
- * You may obtain a copy of Mulan PSL v2 at:
- *          http://license.coscl.org.cn/MulanPSL2
- *
- * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
- * EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
- * MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
- *
- * See the Mulan PSL v2 for more details.
- ***************************************************************************************/
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
 
 #include <isa.h>
-
-/* We use the POSIX regex functions to process regular expressions.
- * Type 'man regex' for more information about POSIX regex functions.
+#include <memory/paddr.h>
+#include <memory/host.h>
+#include "sdb.h"
+#include <ctype.h>
+
+/* The expression is compiled in a single pass: the lexer produces one token
+ * at a time, and a precedence climbing parser emits the ops in reverse polish
+ * notation, so the time is linear in the length of the expression.
+ *
+ * Operators follow C, from the highest precedence to the lowest:
+ *   unary - + ! ~ * (dereference a word in pmem)
+ *   * / %   + -   << >>   < <= > >=   == !=   &   ^   |   &&   ||
+ * '/' and '%' are signed as before, the other ones are unsigned.
  */
-#include <regex.h>
 enum
 {
-  TK_NOTYPE = 256,
-  TK_EQ,
-  TK_DEC,
-  TK_HEX,
+  TK_END,
+  TK_NUM,
   TK_REG,
-
-  /* TODO: Add more token types */
-
+  TK_LP,
+  TK_RP,
+  TK_PLUS,
+  TK_MINUS,
+  TK_STAR,
+  TK_SLASH,
+  TK_PERCENT,
+  TK_SHL,
+  TK_SHR,
+  TK_LT,
+  TK_LE,
+  TK_GT,
+  TK_GE,
+  TK_EQ,
+  TK_NE,
+  TK_AMP,
+  TK_CARET,
+  TK_BAR,
+  TK_LAND,
+  TK_LOR,
+  TK_NOT,
+  TK_TILDE,
+  NR_TK
 };
 
-static struct rule
+// precedence and op of binary operators, 0 for other tokens
+static const struct
 {
-  const char *regex;
-  int token_type;
-} rules[] = {
-
-    /* TODO: Add more rules.
-     * Pay attention to the precedence level of different rules.
-     */
-
-    {" +", TK_NOTYPE},          // spaces
-    {"\\+", '+'},               // plus
-    {"==", TK_EQ},              // equal
-    {"-", '-'},                 // differ
-    {"\\*", '*'},               // multiply
-    {"/", '/'},                 // chuhao
-    {"\\(", '('},               // left
-    {"\\)", ')'},               // right
-    {"0x[0-9a-fA-F]+", TK_HEX}, // Hexadecimal
-    {"[0-9]+", TK_DEC},         // Decimal
-    {"\\$[a-zA-Z0-9]+", TK_REG},
+  int prec;
+  int op;
+} binop[NR_TK] = {
+    [TK_STAR] = {10, OP_MUL},
+    [TK_SLASH] = {10, OP_DIV},
+    [TK_PERCENT] = {10, OP_MOD},
+    [TK_PLUS] = {9, OP_ADD},
+    [TK_MINUS] = {9, OP_SUB},
+    [TK_SHL] = {8, OP_SHL},
+    [TK_SHR] = {8, OP_SHR},
+    [TK_LT] = {7, OP_LT},
+    [TK_LE] = {7, OP_LE},
+    [TK_GT] = {7, OP_GT},
+    [TK_GE] = {7, OP_GE},
+    [TK_EQ] = {6, OP_EQ},
+    [TK_NE] = {6, OP_NE},
+    [TK_AMP] = {5, OP_AND},
+    [TK_CARET] = {4, OP_XOR},
+    [TK_BAR] = {3, OP_OR},
+    [TK_LAND] = {2, OP_LAND},
+    [TK_LOR] = {1, OP_LOR},
 };
 
-#define NR_REGEX ARRLEN(rules)
-
-static regex_t re[NR_REGEX] = {};
-
-void init_regex()
-{
-  int i;
-  char error_msg[128];
-  int ret;
-
-  for (i = 0; i < NR_REGEX; i++)
-  {
-    ret = regcomp(&re[i], rules[i].regex, REG_EXTENDED);
-    if (ret != 0)
-    {
-      regerror(ret, &re[i], error_msg, 128);
-      panic("regex compilation failed: %s\n%s", error_msg, rules[i].regex);
-    }
-  }
-}
-
 typedef struct token
 {
   int type;
-  char str[32];
+  int pos;      // where the token starts
+  word_t num;   // TK_NUM
+  char str[32]; // TK_REG, without '$'
 } Token;
 
-static Token tokens[65536] __attribute__((used)) = {};
-static int nr_token __attribute__((used)) = 0;
+static const char *str; // the expression being compiled
+static int pos;
+static Token tk; // the current token
+static ExprCode *code;
+static int cap; // capacity of code->code
+static int depth;
 
-static bool make_token(char *e)
+static bool error(const char *msg, int at)
 {
-  int position = 0;
-  int i;
-  regmatch_t pmatch;
-
-  nr_token = 0;
+  printf("%s at position %d\n%s\n%*.s^\n", msg, at, str, at, "");
+  return false;
+}
 
-  while (e[position] != '\0')
+static bool next_token()
+{
+  while (str[pos] == ' ' || str[pos] == '\t')
   {
-    for (i = 0; i < NR_REGEX; i++)
-    {
-      if (regexec(&re[i], e + position, 1, &pmatch, 0) == 0 && pmatch.rm_so == 0)
-      {
-        char *substr_start = e + position;
-        int substr_len = pmatch.rm_eo;
-
-        Log("match rules[%d] = \"%s\" at position %d with len %d: %.*s",
-            i, rules[i].regex, position, substr_len, substr_len, substr_start);
-
-        position += substr_len;
-        if (rules[i].token_type == TK_NOTYPE)
-        {
-          break;
-        }
-
-        if (substr_len >= 32)
-        {
-          panic("Buffer overflow: token is too long!");
-        }
-
-        Token *token = &tokens[nr_token];
-
-        strncpy(token->str, substr_start, substr_len);
-
-        token->str[substr_len] = '\0';
-        token->type = rules[i].token_type;
+    pos++;
+  }
 
-        nr_token++;
+  const char *s = str + pos;
+  tk.pos = pos;
+  if (*s == '\0')
+  {
+    tk.type = TK_END;
+    return true;
+  }
 
-        if (nr_token >= 65536)
-        {
-          panic("Error: Token buffer overflow!");
-        }
+  if (isdigit((unsigned char)*s))
+  {
+    char *end;
+    tk.type = TK_NUM;
+    tk.num = strtoull(s, &end, 0);
+    // C suffixes are allowed so that C expressions can be pasted
+    while (*end == 'u' || *end == 'U' || *end == 'l' || *end == 'L')
+    {
+      end++;
+    }
+    if (isalnum((unsigned char)*end) || *end == '_')
+    {
+      return error("Bad number", end - str);
+    }
+    pos = end - str;
+    return true;
+  }
 
-        break;
-      }
+  if (*s == '$')
+  {
+    int len = 1;
+    while (isalnum((unsigned char)s[len]) || s[len] == '_')
+    {
+      len++;
+    }
+    if (len == 1)
+    {
+      return error("Register name expected", pos + 1);
+    }
+    if (len - 1 >= sizeof(tk.str))
+    {
+      return error("Register name is too long", pos);
     }
+    tk.type = TK_REG;
+    memcpy(tk.str, s + 1, len - 1);
+    tk.str[len - 1] = '\0';
+    pos += len;
+    return true;
+  }
 
-    if (i == NR_REGEX)
+  int len = 1;
+  switch (*s)
+  {
+  case '(':
+    tk.type = TK_LP;
+    break;
+  case ')':
+    tk.type = TK_RP;
+    break;
+  case '+':
+    tk.type = TK_PLUS;
+    break;
+  case '-':
+    tk.type = TK_MINUS;
+    break;
+  case '*':
+    tk.type = TK_STAR;
+    break;
+  case '/':
+    tk.type = TK_SLASH;
+    break;
+  case '%':
+    tk.type = TK_PERCENT;
+    break;
+  case '^':
+    tk.type = TK_CARET;
+    break;
+  case '~':
+    tk.type = TK_TILDE;
+    break;
+  case '<':
+    if (s[1] == '<')
+      tk.type = TK_SHL, len = 2;
+    else if (s[1] == '=')
+      tk.type = TK_LE, len = 2;
+    else
+      tk.type = TK_LT;
+    break;
+  case '>':
+    if (s[1] == '>')
+      tk.type = TK_SHR, len = 2;
+    else if (s[1] == '=')
+      tk.type = TK_GE, len = 2;
+    else
+      tk.type = TK_GT;
+    break;
+  case '=':
+    if (s[1] != '=')
     {
-      printf("no match at position %d\n%s\n%*.s^\n", position, e, position, "");
-      return false;
+      return error("'==' expected", pos);
     }
+    tk.type = TK_EQ, len = 2;
+    break;
+  case '!':
+    if (s[1] == '=')
+      tk.type = TK_NE, len = 2;
+    else
+      tk.type = TK_NOT;
+    break;
+  case '&':
+    if (s[1] == '&')
+      tk.type = TK_LAND, len = 2;
+    else
+      tk.type = TK_AMP;
+    break;
+  case '|':
+    if (s[1] == '|')
+      tk.type = TK_LOR, len = 2;
+    else
+      tk.type = TK_BAR;
+    break;
+  default:
+    return error("Unknown character", pos);
   }
+  pos += len;
   return true;
 }
 
-static bool check_parentheses(int p, int q)
+static int emit(ExprOp op)
 {
-  if (tokens[p].type != '(' || tokens[q].type != ')')
+  if (code->len == cap)
   {
-    return false;
+    cap = (cap == 0 ? 16 : cap * 2);
+    code->code = realloc(code->code, sizeof(ExprOp) * cap);
+    assert(code->code);
   }
+  code->code[code->len] = op;
 
-  int n = 0;
-  for (int i = p; i < q; i++)
+  if (op.op <= OP_REG_NAME)
   {
-    if (tokens[i].type == '(')
-      n++;
-    if (tokens[i].type == ')')
-      n--;
-    //Logic: 'cuz i ends at q while not reaching q, 
-    //so if ()couple exist only on two ends, the value of n shoud be 1!
-    //it means that some other ')'appears before the ')'paired with '(' when n==0
-    if (n == 0)
-      return false;
+    depth++;
+  }
+  else if (op.op >= OP_MUL)
+  {
+    depth--;
+  }
+  if (depth > code->depth)
+  {
+    code->depth = depth;
   }
+  return code->len++;
+}
 
-  if (tokens[q].type == ')')
-    n--;
+static bool parse(int min_prec);
 
-  return n == 0;// true means parentheses could be abandoned safely,,false? the opposite!
+static bool parse_unary()
+{
+  int type = tk.type;
+  switch (type)
+  {
+  case TK_NUM:
+    emit((ExprOp){.op = OP_NUM, .num = tk.num});
+    return next_token();
+  case TK_REG:
+  {
+    word_t *reg = isa_reg_str2ptr(tk.str);
+    if (reg != NULL)
+    {
+      emit((ExprOp){.op = OP_REG, .reg = reg});
+      return next_token();
+    }
+    bool success = false;
+    isa_reg_str2val(tk.str, &success);
+    if (!success)
+    {
+      return error("Unknown register", tk.pos);
+    }
+    emit((ExprOp){.op = OP_REG_NAME, .name = strdup(tk.str)});
+    return next_token();
+  }
+  case TK_LP:
+    if (!next_token() || !parse(1))
+    {
+      return false;
+    }
+    if (tk.type != TK_RP)
+    {
+      return error("')' expected", tk.pos);
+    }
+    return next_token();
+  case TK_PLUS:
+  case TK_MINUS:
+  case TK_NOT:
+  case TK_TILDE:
+  case TK_STAR:
+    if (!next_token() || !parse_unary())
+    {
+      return false;
+    }
+    if (type != TK_PLUS)
+    {
+      int op = (type == TK_MINUS ? OP_NEG : type == TK_NOT ? OP_NOT : type == TK_TILDE ? OP_BNOT : OP_DEREF);
+      emit((ExprOp){.op = op});
+    }
+    return true;
+  default:
+    return error("Operand expected", tk.pos);
+  }
 }
 
-int find_main_operator(int p, int q)
+// parse operators with precedence >= min_prec, which are left associative
+static bool parse(int min_prec)
 {
-  int op = -1;
-  int paren = 0;
-
-  for (int i = p; i <= q; i++)
+  if (!parse_unary())
   {
-    if (tokens[i].type == '(')
-      paren++;
-    else if (tokens[i].type == ')')
-      paren--;
+    return false;
+  }
 
-    if (paren == 0)
+  while (binop[tk.type].prec != 0 && binop[tk.type].prec >= min_prec)
+  {
+    int type = tk.type;
+    if (!next_token())
     {
-
-      if (tokens[i].type == '+' || tokens[i].type == '-')
+      return false;
+    }
+    if (type == TK_LAND || type == TK_LOR)
+    {
+      // the jump pops the left side when falling through
+      int j = emit((ExprOp){.op = binop[type].op});
+      if (!parse(binop[type].prec + 1))
       {
-        op = i;
+        return false;
       }
+      emit((ExprOp){.op = OP_BOOL});
+      code->code[j].target = code->len;
     }
-  }
-
-  if (op != -1)
-    return op;
-  paren = 0;
-  for (int i = p; i <= q; i++)
-  {
-    if (tokens[i].type == '(')
-      paren++;
-    else if (tokens[i].type == ')')
-      paren--;
-
-    if (paren == 0)
+    else
     {
-      if (tokens[i].type == '*' || tokens[i].type == '/')
+      if (!parse(binop[type].prec + 1))
       {
-        op = i;
+        return false;
       }
+      emit((ExprOp){.op = binop[type].op});
     }
   }
-
-  return op;
+  return true;
 }
 
-static word_t eval(int p, int q)
+bool expr_compile(char *e, ExprCode *c)
 {
-  if (p > q)
+  c->code = NULL;
+  c->len = c->depth = 0;
+  str = e;
+  pos = 0;
+  code = c;
+  cap = 0;
+  depth = 0;
+
+  if (!next_token() || !parse(1))
   {
-    // Bad expression
-    return 0;
+    expr_free(c);
+    return false;
   }
-  else if (p == q)
+  if (tk.type != TK_END)
   {
-    // Base case: single number
-    // Convert string to unsigned long. 0 means auto-detect base (10 or 16)
+    error("Unexpected token", tk.pos);
+    expr_free(c);
+    return false;
+  }
+  return true;
+}
 
-    if (tokens[p].type == TK_REG)
+void expr_free(ExprCode *c)
+{
+  for (int i = 0; i < c->len; i++)
+  {
+    if (c->code[i].op == OP_REG_NAME)
     {
-      bool success;
-      word_t val = isa_reg_str2val(tokens[p].str + 1, &success);
-      if (!success)
-      {
-        printf("Unknown register: %s\n", tokens[p].str);
-        return 0;
-      }
-      return val;
+      free(c->code[i].name);
     }
-    return strtoul(tokens[p].str, NULL, 0);
   }
-  else if (check_parentheses(p, q) == true)
-  {
-    // The expression is surrounded by parentheses, remove them
-    return eval(p + 1, q - 1);
-  }
-  else
+  free(c->code);
+  c->code = NULL;
+  c->len = c->depth = 0;
+}
+
+#define TOP stack[sp - 1]
+
+word_t expr_eval(const ExprCode *c, bool *success)
+{
+  word_t stack[c->depth + 1];
+  int sp = 0;
+  *success = true;
+
+  for (int i = 0; i < c->len; i++)
   {
-    // General case: split by main operator
-    int op = find_main_operator(p, q);
-    if (op == -1)
+    const ExprOp *op = &c->code[i];
+    switch (op->op)
     {
-      printf("[Error] Main operator not found in range [%d, %d]!\n", p, q);
-      printf("Current expression substring: ");
-      for (int k = p; k <= q; k++)
+    case OP_NUM:
+      stack[sp++] = op->num;
+      continue;
+    case OP_REG:
+      stack[sp++] = *op->reg;
+      continue;
+    case OP_REG_NAME:
+    {
+      bool found;
+      stack[sp++] = isa_reg_str2val(op->name, &found);
+      continue;
+    }
+    case OP_NEG:
+      TOP = -TOP;
+      continue;
+    case OP_NOT:
+      TOP = !TOP;
+      continue;
+    case OP_BNOT:
+      TOP = ~TOP;
+      continue;
+    case OP_BOOL:
+      TOP = (TOP != 0);
+      continue;
+    case OP_DEREF:
+      // only pmem is read, to avoid the side effects of devices
+      if (in_pmem(TOP) && in_pmem(TOP + sizeof(word_t) - 1))
+      {
+        TOP = host_read(guest_to_host(TOP), sizeof(word_t));
+      }
+      else
       {
-        printf("%s", tokens[k].str);
+        *success = false;
+        TOP = 0;
       }
-      printf("\n");
-      return 0;
+      continue;
+    case OP_LAND:
+      if (TOP == 0)
+      {
+        i = op->target - 1;
+      }
+      else
+      {
+        sp--;
+      }
+      continue;
+    case OP_LOR:
+      if (TOP != 0)
+      {
+        TOP = 1;
+        i = op->target - 1;
+      }
+      else
+      {
+        sp--;
+      }
+      continue;
     }
-    // Recursively evaluate both sides
-    word_t val1 = eval(p, op - 1);
-    word_t val2 = eval(op + 1, q);
 
-    // Perform calculation based on the operator type
-    switch (tokens[op].type)
+    word_t val2 = stack[--sp];
+    word_t *val1 = &stack[sp - 1];
+    switch (op->op)
     {
-    case '+':
-      return val1 + val2;
-    case '-':
-      return val1 - val2;
-    case '*':
-      return val1 * val2;
-    case '/':
+    case OP_MUL:
+      *val1 *= val2;
+      break;
+    case OP_DIV:
+    case OP_MOD:
       if (val2 == 0)
       {
-        printf("Error: Division by zero\n");
-        return 0;
+        *success = false;
+        *val1 = 0;
       }
-      return (word_t)((int)val1 / (int)val2);
-    case TK_EQ:
-      return val1 == val2;
+      else if (val2 == (word_t)-1)
+      {
+        // the quotient of the minimum by -1 overflows and traps the host,
+        // so wrap it around as the ISAs do
+        *val1 = (op->op == OP_DIV ? -*val1 : 0);
+      }
+      else
+      {
+        sword_t a = *val1, b = val2;
+        *val1 = (op->op == OP_DIV ? a / b : a % b);
+      }
+      break;
+    case OP_ADD:
+      *val1 += val2;
+      break;
+    case OP_SUB:
+      *val1 -= val2;
+      break;
+    case OP_SHL:
+      *val1 <<= (val2 & (sizeof(word_t) * 8 - 1));
+      break;
+    case OP_SHR:
+      *val1 >>= (val2 & (sizeof(word_t) * 8 - 1));
+      break;
+    case OP_LT:
+      *val1 = (*val1 < val2);
+      break;
+    case OP_LE:
+      *val1 = (*val1 <= val2);
+      break;
+    case OP_GT:
+      *val1 = (*val1 > val2);
+      break;
+    case OP_GE:
+      *val1 = (*val1 >= val2);
+      break;
+    case OP_EQ:
+      *val1 = (*val1 == val2);
+      break;
+    case OP_NE:
+      *val1 = (*val1 != val2);
+      break;
+    case OP_AND:
+      *val1 &= val2;
+      break;
+    case OP_XOR:
+      *val1 ^= val2;
+      break;
+    case OP_OR:
+      *val1 |= val2;
+      break;
     default:
       assert(0);
     }
   }
-  return 0;
+  return stack[0];
 }
 
 word_t expr(char *e, bool *success)
 {
-  if (!make_token(e))
+  ExprCode c;
+  if (!expr_compile(e, &c))
   {
     *success = false;
     return 0;
   }
 
-  /* Start evaluation from the first to the last token */
-  *success = true;
-  return eval(0, nr_token - 1);
-}
\ No newline at end of file
+  word_t val = expr_eval(&c, success);
+  if (!*success)
+  {
+    printf("Error: Division by zero or bad address\n");
+  }
+  expr_free(&c);
+  return val;
+}
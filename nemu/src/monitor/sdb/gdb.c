@@ -0,0 +1,555 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <memory/paddr.h>
+#include <difftest-def.h>
+#include <cpu/reverse.h>
+#include "sdb.h"
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/* A stub of the GDB remote serial protocol. It serves one gdb over a
+ * TCP port on localhost or a UNIX socket. Registers are transferred in
+ * the layout of CPU_state, which already follows the `g' packet of gdb
+ * for DiffTest with QEMU. Memory is copied from guest_to_host() in
+ * blocks, and breakpoints and watchpoints are the ones of sdb, so the
+ * guest runs at full speed until one of them is hit. */
+
+extern uint64_t g_nr_guest_inst;
+
+#define PACKET_SIZE 0x4000
+// check for a Ctrl-C from gdb every so many instructions
+#define RUN_CHUNK (1 << 20)
+
+static int fd = -1;
+static bool noack = false;
+static char rbuf[4096];
+static int rpos = 0, rlen = 0;
+static char in[PACKET_SIZE + 1];
+static char out[PACKET_SIZE * 2 + 16];
+
+static int gdb_getc()
+{
+  if (rpos == rlen)
+  {
+    rlen = read(fd, rbuf, sizeof(rbuf));
+    rpos = 0;
+    if (rlen <= 0)
+    {
+      rlen = 0;
+      return EOF;
+    }
+  }
+  return (unsigned char)rbuf[rpos++];
+}
+
+static void gdb_write(const char *buf, int len)
+{
+  while (len > 0)
+  {
+    int n = write(fd, buf, len);
+    if (n <= 0)
+    {
+      return;
+    }
+    buf += n;
+    len -= n;
+  }
+}
+
+static int hex_nibble(char c)
+{
+  return (c >= '0' && c <= '9') ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+static const char hex_digit[] = "0123456789abcdef";
+
+static char *hex_encode(char *p, const uint8_t *bytes, int len)
+{
+  for (int i = 0; i < len; i++)
+  {
+    *p++ = hex_digit[bytes[i] >> 4];
+    *p++ = hex_digit[bytes[i] & 0xf];
+  }
+  *p = '\0';
+  return p;
+}
+
+static void hex_decode(uint8_t *bytes, const char *p, int len)
+{
+  for (int i = 0; i < len; i++, p += 2)
+  {
+    bytes[i] = (hex_nibble(p[0]) << 4) | hex_nibble(p[1]);
+  }
+}
+
+static void send_packet(const char *data)
+{
+  int len = strlen(data);
+  uint8_t sum = 0;
+  for (int i = 0; i < len; i++)
+  {
+    sum += data[i];
+  }
+  char tail[4];
+  snprintf(tail, sizeof(tail), "#%02x", sum);
+  do
+  {
+    gdb_write("$", 1);
+    gdb_write(data, len);
+    gdb_write(tail, 3);
+  } while (!noack && gdb_getc() == '-');
+}
+
+// return the length of the packet with binary data unescaped,
+// -1 if the connection is closed
+static int recv_packet()
+{
+  int c;
+  while (true)
+  {
+    while ((c = gdb_getc()) != '$')
+    {
+      if (c == EOF)
+      {
+        return -1;
+      }
+    }
+
+    int len = 0;
+    uint8_t sum = 0;
+    bool escape = false;
+    while ((c = gdb_getc()) != '#')
+    {
+      if (c == EOF)
+      {
+        return -1;
+      }
+      sum += c;
+      if (c == '}')
+      {
+        escape = true;
+        continue;
+      }
+      if (len < PACKET_SIZE)
+      {
+        in[len++] = (escape ? c ^ 0x20 : c);
+      }
+      escape = false;
+    }
+    int hi = gdb_getc(), lo = gdb_getc();
+    in[len] = '\0';
+    if (noack)
+    {
+      return len;
+    }
+    bool ok = (lo != EOF && hi != EOF && sum == ((hex_nibble(hi) << 4) | hex_nibble(lo)));
+    gdb_write(ok ? "+" : "-", 1);
+    if (ok)
+    {
+      return len;
+    }
+  }
+}
+
+// whether gdb has sent a Ctrl-C while the guest is running
+static bool gdb_interrupted()
+{
+  struct pollfd pfd = {.fd = fd, .events = POLLIN};
+  while (rpos < rlen || poll(&pfd, 1, 0) > 0)
+  {
+    int c = gdb_getc();
+    if (c == EOF || c == 0x03)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void stop_reply(bool watch, paddr_t watch_addr)
+{
+  switch (nemu_state.state)
+  {
+  case NEMU_END:
+    sprintf(out, "W%02x", nemu_state.halt_ret & 0xff);
+    break;
+  case NEMU_ABORT:
+    strcpy(out, "X06");
+    break;
+  default:
+    if (watch)
+    {
+      sprintf(out, "T05watch:%lx;", (unsigned long)watch_addr);
+    }
+    else
+    {
+      strcpy(out, "S05");
+    }
+  }
+  send_packet(out);
+}
+
+static void gdb_run(bool step)
+{
+  // forget the hits before this run
+  breakpoint_hit();
+  watchpoint_hit();
+  data_wp_hit(NULL);
+
+  paddr_t addr = 0;
+  bool watch = false;
+  if (step)
+  {
+    cpu_exec(1);
+    watch = data_wp_hit(&addr);
+  }
+  else
+  {
+    while (true)
+    {
+      uint64_t start = g_nr_guest_inst;
+      cpu_exec(RUN_CHUNK);
+      // a stop on the last instruction of the chunk is only told by the hits
+      watch = data_wp_hit(&addr);
+      if (nemu_state.state != NEMU_STOP || g_nr_guest_inst - start < RUN_CHUNK || watch ||
+          watchpoint_hit() || breakpoint_hit() || gdb_interrupted())
+      {
+        break;
+      }
+    }
+  }
+  stop_reply(watch, addr);
+}
+
+static bool mem_range_ok(paddr_t addr, word_t len)
+{
+  return len > 0 && in_pmem(addr) && in_pmem(addr + len - 1) && addr + len - 1 >= addr;
+}
+
+// X addr,len:binary and M addr,len:hex, the packet ends at `end'
+static void write_mem(char *args, char *end, bool binary)
+{
+  char *data = strchr(args, ':');
+  paddr_t addr = strtoul(args, &args, 16);
+  word_t len = strtoul(args + 1, NULL, 16);
+  // the payload may be cut at PACKET_SIZE or simply be short
+  if (data == NULL || (uint64_t)(end - data - 1) < (binary ? len : (uint64_t)len * 2))
+  {
+    send_packet("E01");
+    return;
+  }
+  if (len == 0)
+  {
+    send_packet("OK");
+    return;
+  }
+  if (!mem_range_ok(addr, len))
+  {
+    send_packet("E01");
+    return;
+  }
+  IFDEF(CONFIG_CHECKPOINT, pmem_mark_dirty(addr, len));
+  IFDEF(CONFIG_REVERSE, rev_note_write(addr, len));
+  if (binary)
+  {
+    memcpy(guest_to_host(addr), data + 1, len);
+  }
+  else
+  {
+    hex_decode(guest_to_host(addr), data + 1, len);
+  }
+  send_packet("OK");
+}
+
+// m addr,len
+static void read_mem(char *args)
+{
+  paddr_t addr = strtoul(args, &args, 16);
+  word_t len = strtoul(args + 1, NULL, 16);
+  if (len > PACKET_SIZE)
+  {
+    len = PACKET_SIZE;
+  }
+  // only physical memory, as reading a device may change its state
+  if (!mem_range_ok(addr, len))
+  {
+    send_packet("E01");
+    return;
+  }
+  hex_encode(out, guest_to_host(addr), len);
+  send_packet(out);
+}
+
+// Z type,addr,kind and z type,addr,kind
+static void set_point(char *args, bool insert)
+{
+  int type = strtol(args, &args, 10);
+  word_t addr = strtoul(args + 1, &args, 16);
+  int len = strtol(args + 1, NULL, 16);
+  bool ok;
+  switch (type)
+  {
+  case 0: // software breakpoint
+  case 1: // hardware breakpoint
+    ok = insert ? (add_breakpoint(addr), true) : delete_breakpoint_at(addr);
+    break;
+  case 2: // write watchpoint
+    ok = insert ? (add_data_wp(addr, len), true) : delete_data_wp_at(addr, len);
+    break;
+  default: // read and access watchpoints are not supported
+    send_packet("");
+    return;
+  }
+  send_packet(ok ? "OK" : "E01");
+}
+
+static void read_reg(char *args)
+{
+  int n = strtol(args, NULL, 16);
+  if ((n + 1) * sizeof(word_t) > DIFFTEST_REG_SIZE)
+  {
+    // unavailable
+    memset(out, 'x', sizeof(word_t) * 2);
+    out[sizeof(word_t) * 2] = '\0';
+  }
+  else
+  {
+    hex_encode(out, (uint8_t *)&cpu + n * sizeof(word_t), sizeof(word_t));
+  }
+  send_packet(out);
+}
+
+static void write_reg(char *args)
+{
+  char *val = strchr(args, '=');
+  int n = strtol(args, NULL, 16);
+  if (val == NULL || strlen(val + 1) < sizeof(word_t) * 2 || (n + 1) * sizeof(word_t) > DIFFTEST_REG_SIZE)
+  {
+    send_packet("E01");
+    return;
+  }
+  hex_decode((uint8_t *)&cpu + n * sizeof(word_t), val + 1, sizeof(word_t));
+  send_packet("OK");
+}
+
+// vCont;ACTION[:thread]... we only have one thread, so the first action wins
+static void resume(char *args)
+{
+  if (args[0] == '?')
+  {
+    send_packet("vCont;c;C;s;S");
+    return;
+  }
+  char action = (args[0] == ';' ? args[1] : '\0');
+  if (action == 'c' || action == 'C' || action == 's' || action == 'S')
+  {
+    gdb_run(action == 's' || action == 'S');
+    return;
+  }
+  send_packet("");
+}
+
+static void query(char *args)
+{
+  if (strncmp(args, "Supported", 9) == 0)
+  {
+    sprintf(out, "PacketSize=%x;QStartNoAckMode+", PACKET_SIZE);
+    send_packet(out);
+  }
+  else if (strcmp(args, "Attached") == 0)
+  {
+    send_packet("1");
+  }
+  else if (strcmp(args, "C") == 0)
+  {
+    send_packet("QC1");
+  }
+  else if (strcmp(args, "fThreadInfo") == 0)
+  {
+    send_packet("m1");
+  }
+  else if (strcmp(args, "sThreadInfo") == 0)
+  {
+    send_packet("l");
+  }
+  else if (strncmp(args, "Symbol", 6) == 0)
+  {
+    send_packet("OK");
+  }
+  else
+  {
+    send_packet("");
+  }
+}
+
+// return false when the session is over
+static bool handle_packet(int len)
+{
+  char *args = in + 1;
+  switch (in[0])
+  {
+  case '?':
+    stop_reply(false, 0);
+    break;
+  case 'g':
+    hex_encode(out, (uint8_t *)&cpu, DIFFTEST_REG_SIZE);
+    send_packet(out);
+    break;
+  case 'G':
+    if (len - 1 < DIFFTEST_REG_SIZE * 2)
+    {
+      send_packet("E01");
+      break;
+    }
+    hex_decode((uint8_t *)&cpu, args, DIFFTEST_REG_SIZE);
+    send_packet("OK");
+    break;
+  case 'p':
+    read_reg(args);
+    break;
+  case 'P':
+    write_reg(args);
+    break;
+  case 'm':
+    read_mem(args);
+    break;
+  case 'M':
+    write_mem(args, in + len, false);
+    break;
+  case 'X':
+    write_mem(args, in + len, true);
+    break;
+  case 'c':
+  case 's':
+    if (*args != '\0')
+    {
+      cpu.pc = strtoul(args, NULL, 16);
+    }
+    gdb_run(in[0] == 's');
+    break;
+  case 'Z':
+  case 'z':
+    set_point(args, in[0] == 'Z');
+    break;
+  case 'v':
+    if (strncmp(args, "Cont", 4) == 0)
+    {
+      resume(args + 4);
+    }
+    else if (strncmp(args, "Kill", 4) == 0)
+    {
+      send_packet("OK");
+      nemu_state.state = NEMU_QUIT;
+      return false;
+    }
+    else
+    {
+      send_packet("");
+    }
+    break;
+  case 'q':
+    query(args);
+    break;
+  case 'Q':
+    if (strcmp(args, "StartNoAckMode") == 0)
+    {
+      send_packet("OK");
+      noack = true;
+    }
+    else
+    {
+      send_packet("");
+    }
+    break;
+  case 'H':
+  case 'T':
+    send_packet("OK");
+    break;
+  case 'D':
+    send_packet("OK");
+    return false;
+  case 'k':
+    nemu_state.state = NEMU_QUIT;
+    return false;
+  default:
+    send_packet("");
+  }
+  return true;
+}
+
+// TARGET is a port on localhost, or the path of a UNIX socket
+static int gdb_listen(const char *target)
+{
+  int sock;
+  char *end;
+  long port = strtol(target, &end, 10);
+  if (*end == '\0')
+  {
+    struct sockaddr_in sa = {.sin_family = AF_INET, .sin_port = htons(port)};
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    Assert(bind(sock, (struct sockaddr *)&sa, sizeof(sa)) == 0, "Can not bind to port %ld", port);
+  }
+  else
+  {
+    struct sockaddr_un sa = {.sun_family = AF_UNIX};
+    Assert(strlen(target) < sizeof(sa.sun_path), "The socket path '%s' is too long", target);
+    strcpy(sa.sun_path, target);
+    unlink(target);
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    Assert(bind(sock, (struct sockaddr *)&sa, sizeof(sa)) == 0, "Can not bind to '%s'", target);
+  }
+  Assert(listen(sock, 1) == 0, "Can not listen on '%s'", target);
+  Log("Waiting for gdb on %s%s", (*end == '\0' ? "localhost:" : ""), target);
+
+  int conn = accept(sock, NULL, NULL);
+  Assert(conn >= 0, "Can not accept the connection from gdb");
+  close(sock);
+  if (*end == '\0')
+  {
+    int on = 1;
+    setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+  return conn;
+}
+
+void gdb_mainloop(const char *target)
+{
+  fd = gdb_listen(target);
+  Log("gdb connected");
+
+  int len;
+  while ((len = recv_packet()) >= 0 && handle_packet(len))
+    ;
+  close(fd);
+  Log("gdb disconnected");
+
+  // the guest keeps running after gdb detaches
+  if (nemu_state.state == NEMU_STOP || nemu_state.state == NEMU_RUNNING)
+  {
+    cpu_exec(-1);
+  }
+}
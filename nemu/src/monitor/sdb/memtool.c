@@ -0,0 +1,279 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#define _GNU_SOURCE // memmem()
+#include <isa.h>
+#include <memory/paddr.h>
+#include "sdb.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Commands to inspect large ranges of guest memory. They work on the
+ * host copy of pmem returned by guest_to_host(), so a whole range is
+ * handled by one fwrite(), memmem() or memcmp() instead of a read per
+ * word. Devices are never touched. */
+
+#define MAX_REPORT 16
+
+// parse N EXPR, and check that [addr, addr + n) is in pmem
+static bool parse_range(char *args, paddr_t *addr, word_t *n)
+{
+  char *arg_n = strtok(args, " ");
+  char *arg_expr = strtok(NULL, "");
+  if (arg_n == NULL || arg_expr == NULL)
+  {
+    return false;
+  }
+  *n = strtoul(arg_n, NULL, 0);
+  bool success;
+  *addr = expr(arg_expr, &success);
+  if (!success)
+  {
+    printf("Error: Invalid expression.\n");
+    return false;
+  }
+  if (*n == 0 || !in_pmem(*addr) || !in_pmem(*addr + *n - 1) || *addr + *n - 1 < *addr)
+  {
+    printf("Error: [" FMT_PADDR ", " FMT_PADDR "] is not in pmem.\n", *addr, *addr + *n - 1);
+    return false;
+  }
+  return true;
+}
+
+// dump FILE N EXPR
+int cmd_dump(char *args)
+{
+  char *file = strtok(args, " ");
+  char *range = strtok(NULL, "");
+  paddr_t addr;
+  word_t n;
+  if (file == NULL || range == NULL)
+  {
+    printf("Usage: dump FILE N EXPR\n");
+    return 0;
+  }
+  if (!parse_range(range, &addr, &n))
+  {
+    return 0;
+  }
+
+  FILE *fp = fopen(file, "wb");
+  if (fp == NULL)
+  {
+    printf("Error: Can not open '%s'.\n", file);
+    return 0;
+  }
+  size_t ret = fwrite(guest_to_host(addr), 1, n, fp);
+  fclose(fp);
+  printf("Dumped %zu bytes at " FMT_PADDR " to %s\n", ret, addr, file);
+  return 0;
+}
+
+// PATTERN is "text" or hex digits of the bytes in memory order
+static int parse_pattern(char *s, uint8_t *buf, int size)
+{
+  int len = strlen(s);
+  if (len >= 2 && s[0] == '"' && s[len - 1] == '"')
+  {
+    len -= 2;
+    if (len > size)
+    {
+      return -1;
+    }
+    memcpy(buf, s + 1, len);
+    return len;
+  }
+  if (len % 2 != 0 || len / 2 > size || strspn(s, "0123456789abcdefABCDEF") != len)
+  {
+    return -1;
+  }
+  for (int i = 0; i < len / 2; i++)
+  {
+    sscanf(s + i * 2, "%2hhx", &buf[i]);
+  }
+  return len / 2;
+}
+
+// search PATTERN [N EXPR], in the whole pmem without a range
+int cmd_search(char *args)
+{
+  char *arg_pat = strtok(args, " ");
+  char *range = strtok(NULL, "");
+  uint8_t pat[256];
+  int len = (arg_pat == NULL ? -1 : parse_pattern(arg_pat, pat, sizeof(pat)));
+  if (len <= 0)
+  {
+    printf("Usage: search PATTERN [N EXPR], where PATTERN is \"text\" or hex bytes like 7f454c46\n");
+    return 0;
+  }
+
+  paddr_t addr = CONFIG_MBASE;
+  word_t n = CONFIG_MSIZE;
+  if (range != NULL && !parse_range(range, &addr, &n))
+  {
+    return 0;
+  }
+
+  const uint8_t *start = guest_to_host(addr), *end = start + n;
+  uint64_t count = 0;
+  for (const uint8_t *p = start; (p = memmem(p, end - p, pat, len)) != NULL; p++)
+  {
+    if (count < MAX_REPORT)
+    {
+      printf(FMT_PADDR "\n", (paddr_t)(addr + (p - start)));
+    }
+    count++;
+  }
+  if (count > MAX_REPORT)
+  {
+    printf("...\n");
+  }
+  printf("%" PRIu64 " match%s\n", count, (count == 1 ? "" : "es"));
+  return 0;
+}
+
+/* Report the runs of different bytes. Equal pages are skipped by
+ * memcmp() and only the different ones are scanned byte by byte. */
+static void diff_bytes(const uint8_t *a, const uint8_t *b, uint64_t n, uint64_t base_a, uint64_t base_b)
+{
+  const uint64_t block = 4096;
+  uint64_t nr_run = 0, nr_byte = 0;
+  uint64_t run = 0;
+  bool in_run = false;
+  for (uint64_t off = 0; off < n; off += block)
+  {
+    uint64_t len = (n - off < block ? n - off : block);
+    if (!in_run && memcmp(a + off, b + off, len) == 0)
+    {
+      continue;
+    }
+    for (uint64_t i = off; i < off + len; i++)
+    {
+      bool differ = (a[i] != b[i]);
+      nr_byte += differ;
+      if (differ && !in_run)
+      {
+        run = i;
+        in_run = true;
+      }
+      else if (!differ && in_run)
+      {
+        if (nr_run++ < MAX_REPORT)
+        {
+          printf("0x%08" PRIx64 " 0x%08" PRIx64 ": %" PRIu64 " bytes\n", base_a + run, base_b + run, i - run);
+        }
+        in_run = false;
+      }
+    }
+  }
+  if (in_run && nr_run++ < MAX_REPORT)
+  {
+    printf("0x%08" PRIx64 " 0x%08" PRIx64 ": %" PRIu64 " bytes\n", base_a + run, base_b + run, n - run);
+  }
+  if (nr_run > MAX_REPORT)
+  {
+    printf("...\n");
+  }
+  printf("%" PRIu64 " different bytes in %" PRIu64 " range%s\n", nr_byte, nr_run, (nr_run == 1 ? "" : "s"));
+}
+
+// mdiff N EXPR1, EXPR2
+int cmd_mdiff(char *args)
+{
+  char *comma = (args == NULL ? NULL : strchr(args, ','));
+  if (comma == NULL)
+  {
+    printf("Usage: mdiff N EXPR1, EXPR2\n");
+    return 0;
+  }
+  *comma = '\0';
+  paddr_t a;
+  word_t n;
+  if (!parse_range(args, &a, &n))
+  {
+    return 0;
+  }
+  bool success;
+  paddr_t b = expr(comma + 1, &success);
+  if (!success)
+  {
+    printf("Error: Invalid expression.\n");
+    return 0;
+  }
+  if (!in_pmem(b) || !in_pmem(b + n - 1) || b + n - 1 < b)
+  {
+    printf("Error: [" FMT_PADDR ", " FMT_PADDR "] is not in pmem.\n", b, b + n - 1);
+    return 0;
+  }
+  diff_bytes(guest_to_host(a), guest_to_host(b), n, a, b);
+  return 0;
+}
+
+static void *map_file(const char *file, uint64_t *size)
+{
+  int fd = open(file, O_RDONLY);
+  if (fd < 0)
+  {
+    printf("Error: Can not open '%s'.\n", file);
+    return NULL;
+  }
+  struct stat st;
+  fstat(fd, &st);
+  *size = st.st_size;
+  void *p = (st.st_size == 0 ? NULL : mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
+  close(fd);
+  if (p == MAP_FAILED || p == NULL)
+  {
+    printf("Error: Can not map '%s'.\n", file);
+    return NULL;
+  }
+  return p;
+}
+
+// fdiff FILE1 FILE2, usually two files written by dump
+int cmd_fdiff(char *args)
+{
+  char *file1 = strtok(args, " ");
+  char *file2 = strtok(NULL, " ");
+  if (file1 == NULL || file2 == NULL)
+  {
+    printf("Usage: fdiff FILE1 FILE2\n");
+    return 0;
+  }
+  uint64_t size1, size2;
+  uint8_t *p1 = map_file(file1, &size1);
+  if (p1 == NULL)
+  {
+    return 0;
+  }
+  uint8_t *p2 = map_file(file2, &size2);
+  if (p2 == NULL)
+  {
+    munmap(p1, size1);
+    return 0;
+  }
+  uint64_t n = (size1 < size2 ? size1 : size2);
+  if (size1 != size2)
+  {
+    printf("Sizes differ: %" PRIu64 " and %" PRIu64 " bytes, only the first %" PRIu64 " are compared\n", size1, size2, n);
+  }
+  diff_bytes(p1, p2, n, 0, 0);
+  munmap(p1, size1);
+  munmap(p2, size2);
+  return 0;
+}
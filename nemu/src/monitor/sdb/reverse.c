@@ -0,0 +1,374 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <isa.h>
+#include <cpu/cpu.h>
+#include <cpu/reverse.h>
+#include <checkpoint.h>
+#include <memory/paddr.h>
+#include "sdb.h"
+
+#ifdef CONFIG_REVERSE
+
+/* Reverse execution goes back to the latest snapshot before the target
+ * and runs forward to it.
+ *
+ * A snapshot keeps the registered state except pmem, which is small. For
+ * pmem, every snapshot keeps the old content of the pages written first
+ * after it, so undoing the snapshots from the latest one restores pmem
+ * at any of them. The data read from devices are recorded, and returned
+ * again when the history is replayed without running the devices, which
+ * makes the replay deterministic. When the replay reaches the end of the
+ * history, the devices are restored to where they were left. */
+
+#define NR_SNAPSHOT CONFIG_REVERSE_NR_SNAPSHOT
+#define PMEM_PAGE 4096
+#define NONE UINT64_MAX
+
+typedef struct
+{
+  paddr_t pg;
+  uint8_t data[PMEM_PAGE];
+} UndoPage;
+
+typedef struct
+{
+  uint64_t inst;  // taken after this number of instructions
+  uint8_t *state; // the registered state except pmem
+  size_t log_pos; // the first device read after it
+  UndoPage *undo; // the old content of the pages written first after it
+  int nr_undo, cap_undo;
+} Snapshot;
+
+typedef struct
+{
+  uint64_t inst;
+  word_t data;
+} ReadLog;
+
+uint64_t rev_dirty[(CONFIG_MSIZE / PMEM_PAGE + 63) / 64] = {};
+bool rev_replaying = false;
+uint64_t rev_next_event = 0;
+
+// a ring of snapshots, the oldest one is at snap_head
+static Snapshot snap[NR_SNAPSHOT] = {};
+static int snap_head = 0, nr_snap = 0;
+static size_t state_size = 0;
+
+static ReadLog *rlog = NULL;
+static size_t log_len = 0, log_cap = 0, log_pos = 0;
+
+// the end of the recorded history and the state there, valid when replaying
+static uint64_t frontier = 0;
+static uint8_t *frontier_state = NULL;
+
+#define SNAP(i) (&snap[(snap_head + (i)) % NR_SNAPSHOT])
+#define LATEST SNAP(nr_snap - 1)
+
+static void update_next_event()
+{
+  rev_next_event = LATEST->inst + CONFIG_REVERSE_INTERVAL;
+  if (rev_replaying && frontier < rev_next_event)
+  {
+    rev_next_event = frontier;
+  }
+}
+
+void rev_save_page(paddr_t pg)
+{
+  rev_dirty[pg / 64] |= 1ull << (pg % 64);
+  Snapshot *s = LATEST;
+  if (s->nr_undo == s->cap_undo)
+  {
+    s->cap_undo = (s->cap_undo == 0 ? 16 : s->cap_undo * 2);
+    s->undo = realloc(s->undo, sizeof(UndoPage) * s->cap_undo);
+    assert(s->undo);
+  }
+  UndoPage *u = &s->undo[s->nr_undo++];
+  u->pg = pg;
+  memcpy(u->data, guest_to_host(CONFIG_MBASE + pg * PMEM_PAGE), PMEM_PAGE);
+}
+
+// restore the pages written after the snapshot
+static void undo(Snapshot *s)
+{
+  for (int i = 0; i < s->nr_undo; i++)
+  {
+    paddr_t addr = CONFIG_MBASE + s->undo[i].pg * PMEM_PAGE;
+    memcpy(guest_to_host(addr), s->undo[i].data, PMEM_PAGE);
+    pmem_mark_dirty(addr, PMEM_PAGE);
+  }
+  s->nr_undo = 0;
+}
+
+static void free_snapshot(Snapshot *s)
+{
+  free(s->undo);
+  free(s->state);
+  memset(s, 0, sizeof(*s));
+}
+
+static void take_snapshot()
+{
+  if (nr_snap == NR_SNAPSHOT)
+  {
+    // forget the oldest history, with the device reads in it
+    free_snapshot(SNAP(0));
+    snap_head = (snap_head + 1) % NR_SNAPSHOT;
+    nr_snap--;
+    size_t base = SNAP(0)->log_pos;
+    memmove(rlog, rlog + base, sizeof(ReadLog) * (log_len - base));
+    log_len -= base;
+    log_pos -= base;
+    for (int i = 0; i < nr_snap; i++)
+    {
+      SNAP(i)->log_pos -= base;
+    }
+  }
+
+  Snapshot *s = SNAP(nr_snap++);
+  s->inst = g_nr_guest_inst;
+  s->state = malloc(state_size);
+  assert(s->state);
+  ckpt_state_save(s->state);
+  s->log_pos = log_pos;
+  memset(rev_dirty, 0, sizeof(rev_dirty));
+  update_next_event();
+}
+
+// called by cpu-exec when g_nr_guest_inst reaches rev_next_event
+void rev_event()
+{
+  if (rev_replaying && g_nr_guest_inst == frontier)
+  {
+    Assert(log_pos == log_len, "Replay diverged: %zu device reads are not replayed", log_len - log_pos);
+    ckpt_state_load(frontier_state);
+    rev_replaying = false;
+  }
+  if (g_nr_guest_inst >= LATEST->inst + CONFIG_REVERSE_INTERVAL)
+  {
+    take_snapshot();
+  }
+  update_next_event();
+}
+
+word_t rev_replay_read()
+{
+  Assert(log_pos < log_len && rlog[log_pos].inst == g_nr_guest_inst,
+         "Replay diverged: unexpected device read at instruction %" PRIu64 ", pc = " FMT_WORD, g_nr_guest_inst, cpu.pc);
+  return rlog[log_pos++].data;
+}
+
+void rev_record_read(word_t data)
+{
+  if (log_len == log_cap)
+  {
+    log_cap = (log_cap == 0 ? 1024 : log_cap * 2);
+    rlog = realloc(rlog, sizeof(ReadLog) * log_cap);
+    assert(rlog);
+  }
+  rlog[log_len++] = (ReadLog){g_nr_guest_inst, data};
+  log_pos = log_len;
+}
+
+// drop the history and start from the current state
+void rev_reset()
+{
+  for (int i = 0; i < nr_snap; i++)
+  {
+    free_snapshot(SNAP(i));
+  }
+  snap_head = nr_snap = 0;
+  log_len = log_pos = 0;
+  rev_replaying = false;
+  state_size = ckpt_state_size();
+  free(frontier_state);
+  frontier_state = malloc(state_size);
+  assert(frontier_state);
+  take_snapshot();
+}
+
+// restore the latest snapshot not after `target'
+static void restore(uint64_t target)
+{
+  if (!rev_replaying)
+  {
+    // leave the devices at the end of the recorded history
+    frontier = g_nr_guest_inst;
+    ckpt_state_save(frontier_state);
+    rev_replaying = true;
+  }
+  while (LATEST->inst > target)
+  {
+    undo(LATEST);
+    free_snapshot(LATEST);
+    nr_snap--;
+  }
+  undo(LATEST);
+  memset(rev_dirty, 0, sizeof(rev_dirty));
+  ckpt_state_load(LATEST->state);
+  log_pos = LATEST->log_pos;
+  nemu_state.state = NEMU_STOP;
+  update_next_event();
+  resync_watchpoint();
+  ckpt_sync_ref();
+}
+
+// silence the breakpoints and the traces when going through the history
+static FILE *null_fp = NULL, *saved_stdout = NULL, *saved_log = NULL;
+
+static void quiet_begin()
+{
+  extern FILE *log_fp;
+  fflush(stdout);
+  if (null_fp == NULL)
+  {
+    null_fp = fopen("/dev/null", "w");
+    assert(null_fp);
+  }
+  saved_stdout = stdout;
+  saved_log = log_fp;
+  stdout = null_fp;
+  if (log_fp == saved_stdout)
+  {
+    log_fp = null_fp;
+  }
+}
+
+static void quiet_end()
+{
+  extern FILE *log_fp;
+  stdout = saved_stdout;
+  log_fp = saved_log;
+}
+
+static bool can_run()
+{
+  return nemu_state.state == NEMU_STOP || nemu_state.state == NEMU_RUNNING;
+}
+
+// forget the hits on the way
+static bool stop_hit()
+{
+  bool hit = breakpoint_hit();
+  hit |= data_wp_hit(NULL);
+  hit |= watchpoint_hit();
+  return hit;
+}
+
+static void go(uint64_t target)
+{
+  if (target < g_nr_guest_inst)
+  {
+    restore(target);
+  }
+  while (g_nr_guest_inst < target && can_run())
+  {
+    cpu_exec(target - g_nr_guest_inst);
+  }
+  stop_hit();
+}
+
+// the latest snapshot before `inst'
+static uint64_t snapshot_before(uint64_t inst)
+{
+  for (int i = nr_snap - 1; i >= 0; i--)
+  {
+    if (SNAP(i)->inst < inst)
+    {
+      return SNAP(i)->inst;
+    }
+  }
+  return NONE;
+}
+
+static void show_position()
+{
+  printf("Instruction %" PRIu64 ", pc = " FMT_WORD "\n", g_nr_guest_inst, cpu.pc);
+}
+
+// rsi [N]
+int cmd_rsi(char *args)
+{
+  uint64_t n = (args == NULL ? 1 : strtoull(args, NULL, 0));
+  if (n > g_nr_guest_inst - SNAP(0)->inst)
+  {
+    printf("Can not go back before instruction %" PRIu64 "\n", SNAP(0)->inst);
+    return 0;
+  }
+  quiet_begin();
+  go(g_nr_guest_inst - n);
+  quiet_end();
+  show_position();
+  return 0;
+}
+
+// goto [N], show the history without N
+int cmd_goto(char *args)
+{
+  if (args == NULL)
+  {
+    printf("History from instruction %" PRIu64 " to %" PRIu64 ", %d snapshots, %zu device reads, now at %" PRIu64 "\n",
+           SNAP(0)->inst, (rev_replaying ? frontier : g_nr_guest_inst), nr_snap, log_len, g_nr_guest_inst);
+    return 0;
+  }
+  uint64_t target = strtoull(args, NULL, 0);
+  if (target < SNAP(0)->inst)
+  {
+    printf("Can not go back before instruction %" PRIu64 "\n", SNAP(0)->inst);
+    return 0;
+  }
+  quiet_begin();
+  go(target);
+  quiet_end();
+  show_position();
+  return 0;
+}
+
+/* Go back to the last stop by breakpoints or watchpoints. The intervals
+ * between snapshots are replayed from the latest one, and the last stop
+ * in the first interval having any is the target. */
+int cmd_rc(char *args)
+{
+  uint64_t hi = g_nr_guest_inst, stop = NONE, lo;
+  // the stop at the current instruction does not count
+  bool include_hi = false;
+
+  quiet_begin();
+  for (; stop == NONE && (lo = snapshot_before(hi)) != NONE; hi = lo, include_hi = true)
+  {
+    go(lo);
+    while (g_nr_guest_inst < hi && can_run())
+    {
+      cpu_exec(hi - g_nr_guest_inst);
+      if (stop_hit() && (g_nr_guest_inst < hi || include_hi))
+      {
+        stop = g_nr_guest_inst;
+      }
+    }
+  }
+  go(stop != NONE ? stop : SNAP(0)->inst);
+  quiet_end();
+
+  if (stop == NONE)
+  {
+    printf("No breakpoint or watchpoint is hit since instruction %" PRIu64 "\n", g_nr_guest_inst);
+  }
+  show_position();
+  return 0;
+}
+
+#endif
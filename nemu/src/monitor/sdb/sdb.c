@@ -19,15 +19,38 @@
 #include <readline/history.h>
 #include "sdb.h"
 #include <stdlib.h>
+#include <unistd.h>
 #include <memory/vaddr.h>
+#include <memory/paddr.h>
+#include <memory/host.h>
+#include <cpu/iqueue.h>
+#include <cpu/perf.h>
+#include <cpu/timing.h>
+#include <checkpoint.h>
 
 static int is_batch_mode = false;
+static bool is_json_mode = false;
+static char *script_file = NULL;
+static char *gdb_target = NULL;
 
-void init_regex();
 void init_wp_pool();
 int cmd_w(char *args);
 int cmd_d(char *args);
+int cmd_wm(char *args);
+int cmd_b(char *args);
+int cmd_tb(char *args);
+int cmd_ignore(char *args);
+int cmd_cond(char *args);
+void list_breakpoint();
 void list_watchpoint();
+int cmd_dump(char *args);
+int cmd_search(char *args);
+int cmd_mdiff(char *args);
+int cmd_fdiff(char *args);
+int cmd_rsi(char *args);
+int cmd_rc(char *args);
+int cmd_goto(char *args);
+void gdb_mainloop(const char *target);
 /* We use the `readline' library to provide more flexibility to read from stdin. */
 static char *rl_gets()
 {
@@ -139,20 +162,32 @@ static int cmd_x(char *args)
   }
   int n = atoi(n_str);
 
-  char *addr_str = strtok(NULL, " ");
+  char *addr_str = strtok(NULL, "");
   if (addr_str == NULL)
   {
     printf("Missing argument EXPR\n");
     return 0;
   }
 
-  vaddr_t addr;
-  sscanf(addr_str, "%x", &addr);
+  bool success;
+  vaddr_t addr = expr(addr_str, &success);
+  if (!success)
+  {
+    printf("Error: Invalid expression.\n");
+    return 0;
+  }
 
   printf("Address    Data\n");
   for (int i = 0; i < n; i++)
   {
-    uint32_t data = vaddr_read(addr, 4);
+    // only pmem is read, so that inspecting memory does not trigger the side
+    // effects of devices, nor count as a guest access in the models
+    if (!in_pmem(addr) || !in_pmem(addr + 3))
+    {
+      printf("Cannot access memory at address 0x%08x\n", addr);
+      break;
+    }
+    uint32_t data = host_read(guest_to_host(addr), 4);
 
     printf("0x%08x: 0x%08x\n", addr, data);
 
@@ -166,7 +201,7 @@ static int cmd_info(char *args)
 {
   if (args == NULL)
   {
-    printf("Missing argument. Try 'r' or 'w'\n");
+    printf("Missing argument. Try 'r', 'w', 'b', 'i' or 'perf'\n");
     return 0;
   }
 
@@ -178,12 +213,73 @@ static int cmd_info(char *args)
   {
     list_watchpoint();
   }
+  else if (strcmp(args, "b") == 0)
+  {
+    list_breakpoint();
+  }
+  else if (strcmp(args, "i") == 0)
+  {
+    iqueue_dump();
+  }
+  else if (strcmp(args, "perf") == 0)
+  {
+    perf_display();
+  }
   else
   {
     printf("Unknown argument: %s\n", args);
   }
   return 0;
 }
+#ifdef CONFIG_TIMING
+static int cmd_timing(char *args)
+{
+  char *arg = strtok(args, " ");
+  if (arg == NULL)
+  {
+    timing_display();
+  }
+  else if (strcmp(arg, "on") == 0 || strcmp(arg, "off") == 0)
+  {
+    timing_set(strcmp(arg, "on") == 0);
+  }
+  else
+  {
+    printf("Unknown argument: %s\n", arg);
+  }
+  return 0;
+}
+#endif
+
+#ifdef CONFIG_CHECKPOINT
+static int cmd_save(char *args)
+{
+  char *file = strtok(args, " ");
+  if (file == NULL)
+  {
+    printf("Usage: save FILE\n");
+    return 0;
+  }
+  ckpt_save(file, true);
+  return 0;
+}
+
+static int cmd_load(char *args)
+{
+  char *file = strtok(args, " ");
+  if (file == NULL)
+  {
+    printf("Usage: load FILE\n");
+    return 0;
+  }
+  if (ckpt_load(file))
+  {
+    printf("Restored checkpoint %s, pc = " FMT_WORD "\n", file, cpu.pc);
+  }
+  return 0;
+}
+#endif
+
 static int cmd_help(char *args);
 static int cmd_p(char *args)
 {
@@ -219,11 +315,32 @@ static struct
     {"c", "Continue the execution of the program", cmd_c},
     {"q", "Exit NEMU", cmd_q},
     {"si", "Step N instruction", cmd_si},
-    {"info", "Display program status (r: registers,w: watchpoints)", cmd_info},
+    {"info", "Display program status (r: registers,w: watchpoints,b: breakpoints,i: latest instructions,perf: performance counters)", cmd_info},
     {"x", "Scan memory (x N EXPR)", cmd_x},
     {"p", "Evaluate expression", cmd_p},
     {"w", "Set a watchpoint", cmd_w},
-    {"d", "Delete a watchpoint", cmd_d},
+    {"wm", "Set a data watchpoint on N bytes of memory (wm N EXPR)", cmd_wm},
+    {"b", "Set a breakpoint (b [EXPR] [if COND]), at the current pc without EXPR", cmd_b},
+    {"tb", "Set a temporary breakpoint (tb [EXPR] [if COND])", cmd_tb},
+    {"ignore", "Ignore the next COUNT hits of a breakpoint (ignore N COUNT)", cmd_ignore},
+    {"cond", "Set or remove the condition of a breakpoint (cond N [COND])", cmd_cond},
+    {"d", "Delete a watchpoint or a breakpoint", cmd_d},
+    {"dump", "Write N bytes of memory to a file (dump FILE N EXPR)", cmd_dump},
+    {"search", "Search memory for \"text\" or hex bytes (search PATTERN [N EXPR])", cmd_search},
+    {"mdiff", "Compare two ranges of memory (mdiff N EXPR1, EXPR2)", cmd_mdiff},
+    {"fdiff", "Compare two files written by dump (fdiff FILE1 FILE2)", cmd_fdiff},
+#ifdef CONFIG_TIMING
+    {"timing", "Switch the timing model (timing [on|off]), show the cycles without argument", cmd_timing},
+#endif
+#ifdef CONFIG_CHECKPOINT
+    {"save", "Save the machine to a checkpoint in the background (save FILE)", cmd_save},
+    {"load", "Restore the machine from a checkpoint (load FILE)", cmd_load},
+#endif
+#ifdef CONFIG_REVERSE
+    {"rsi", "Step N instructions backwards (rsi [N])", cmd_rsi},
+    {"rc", "Continue backwards to the last stop by a breakpoint or a watchpoint", cmd_rc},
+    {"goto", "Go to instruction count N in either direction, show the history without N (goto [N])", cmd_goto},
+#endif
     /* TODO: Add more commands */
 
 };
@@ -264,64 +381,367 @@ void sdb_set_batch_mode()
   is_batch_mode = true;
 }
 
-void sdb_mainloop()
+void sdb_set_script(char *file)
 {
-  if (is_batch_mode)
+  script_file = file;
+}
+
+void sdb_set_json_mode()
+{
+  is_json_mode = true;
+}
+
+void sdb_set_gdb(char *target)
+{
+  gdb_target = target;
+}
+
+/* Run one command line. Return a negative value to quit sdb. */
+static int exec_cmd(char *str)
+{
+  char *str_end = str + strlen(str);
+
+  /* extract the first token as the command */
+  char *cmd = strtok(str, " ");
+  if (cmd == NULL)
   {
-    cmd_c(NULL);
-    return;
+    return 0;
   }
 
-  for (char *str; (str = rl_gets()) != NULL;)
+  /* treat the remaining string as the arguments,
+   * which may need further parsing
+   */
+  char *args = cmd + strlen(cmd) + 1;
+  if (args >= str_end)
+  {
+    args = NULL;
+  }
+
+#ifdef CONFIG_DEVICE
+  extern void sdl_clear_event_queue();
+  sdl_clear_event_queue();
+#endif
+
+  for (int i = 0; i < NR_CMD; i++)
+  {
+    if (strcmp(cmd, cmd_table[i].name) == 0)
+    {
+      return cmd_table[i].handler(args);
+    }
+  }
+  printf("Unknown command '%s'\n", cmd);
+  return 0;
+}
+
+static void json_str(const char *s)
+{
+  putchar('"');
+  for (; *s != '\0'; s++)
+  {
+    unsigned char c = *s;
+    if (c == '"' || c == '\\')
+    {
+      printf("\\%c", c);
+    }
+    else if (c == '\n')
+    {
+      printf("\\n");
+    }
+    else if (c < 0x20)
+    {
+      printf("\\u%04x", c);
+    }
+    else
+    {
+      putchar(c);
+    }
+  }
+  putchar('"');
+}
+
+/* Run one command and report it as a single JSON object per line:
+ * the command, everything it printed, and the machine state after it.
+ */
+static int exec_cmd_json(const char *line)
+{
+  static const char *state_name[] = {
+    [NEMU_RUNNING] = "running", [NEMU_STOP] = "stop", [NEMU_END] = "end",
+    [NEMU_ABORT] = "abort", [NEMU_QUIT] = "quit",
+  };
+  char *str = strdup(line);
+  char *out = NULL;
+  size_t size = 0;
+
+  /* the log goes to stdout as well if no log file is given */
+  extern FILE *log_fp;
+  fflush(stdout);
+  FILE *saved = stdout;
+  bool log_to_stdout = (log_fp == stdout);
+  FILE *mem = open_memstream(&out, &size);
+  if (mem != NULL)
+  {
+    stdout = mem;
+    if (log_to_stdout)
+    {
+      log_fp = mem;
+    }
+  }
+  int ret = exec_cmd(str);
+  if (mem != NULL)
+  {
+    fclose(mem);
+    stdout = saved;
+    if (log_to_stdout)
+    {
+      log_fp = saved;
+    }
+  }
+
+  printf("{\"cmd\":");
+  json_str(line);
+  printf(",\"state\":\"%s\",\"pc\":\"" FMT_WORD "\",\"inst\":%" PRIu64,
+         state_name[nemu_state.state], cpu.pc, g_nr_guest_inst);
+  if (nemu_state.state == NEMU_END || nemu_state.state == NEMU_ABORT)
   {
-    char *str_end = str + strlen(str);
+    printf(",\"halt_ret\":%u", nemu_state.halt_ret);
+  }
+  printf(",\"output\":");
+  json_str(out == NULL ? "" : out);
+  printf("}\n");
+  fflush(stdout);
+
+  free(out);
+  free(str);
+  return ret;
+}
+
+static bool guest_finished()
+{
+  return nemu_state.state == NEMU_END || nemu_state.state == NEMU_ABORT ||
+         nemu_state.state == NEMU_QUIT;
+}
 
-    /* extract the first token as the command */
-    char *cmd = strtok(str, " ");
-    if (cmd == NULL)
+/* Split a script into commands at newlines and ';'. Braces are
+ * commands of their own so that `repeat N { si; p $pc }' may be
+ * written on one line. Text after '#' is a comment.
+ */
+static char **split_script(char *text, int *nr)
+{
+  int cap = 64, n = 0;
+  char **list = malloc(sizeof(char *) * cap);
+  char *p = text;
+  while (*p != '\0')
+  {
+    p += strspn(p, " \t\r\n;");
+    if (*p == '\0')
+    {
+      break;
+    }
+    char *start = p;
+    if (*p == '{' || *p == '}')
+    {
+      p++;
+    }
+    else if (*p == '#')
     {
+      p += strcspn(p, "\n");
       continue;
     }
+    else
+    {
+      p += strcspn(p, "\r\n;{}#");
+    }
+    char *end = p;
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t'))
+    {
+      end--;
+    }
+    if (n == cap)
+    {
+      cap *= 2;
+      list = realloc(list, sizeof(char *) * cap);
+    }
+    list[n++] = strndup(start, end - start);
+  }
+  *nr = n;
+  return list;
+}
 
-    /* treat the remaining string as the arguments,
-     * which may need further parsing
-     */
-    char *args = cmd + strlen(cmd) + 1;
-    if (args >= str_end)
+/* Return the index of the '}' matching the '{' at cmds[open]. */
+static int match_brace(char **cmds, int open, int hi)
+{
+  int depth = 0;
+  for (int i = open; i < hi; i++)
+  {
+    if (strcmp(cmds[i], "{") == 0)
+    {
+      depth++;
+    }
+    else if (strcmp(cmds[i], "}") == 0 && --depth == 0)
     {
-      args = NULL;
+      return i;
     }
+  }
+  return -1;
+}
 
-#ifdef CONFIG_DEVICE
-    extern void sdl_clear_event_queue();
-    sdl_clear_event_queue();
-#endif
+/* Whether cmd is the header of a `repeat N { ... }' block. */
+static bool is_repeat(const char *cmd)
+{
+  int count;
+  char rest;
+  return sscanf(cmd, "repeat %d %c", &count, &rest) == 1;
+}
 
-    int i;
-    for (i = 0; i < NR_CMD; i++)
+/* Run cmds[lo, hi). Return a negative value to quit sdb. */
+static int run_script(char **cmds, int lo, int hi)
+{
+  for (int i = lo; i < hi; i++)
+  {
+    int count;
+    if (is_repeat(cmds[i]))
+    {
+      sscanf(cmds[i], "repeat %d", &count);
+      int end = (i + 1 < hi && strcmp(cmds[i + 1], "{") == 0) ? match_brace(cmds, i + 1, hi) : -1;
+      if (end < 0)
+      {
+        printf("Expect a block '{ ... }' after '%s'\n", cmds[i]);
+        return -1;
+      }
+      /* stop repeating once the guest is finished,
+       * but still run the commands after the loop
+       */
+      for (int k = 0; k < count && !guest_finished(); k++)
+      {
+        if (run_script(cmds, i + 2, end) < 0)
+        {
+          return -1;
+        }
+      }
+      i = end;
+      continue;
+    }
+    if (strcmp(cmds[i], "{") == 0 || strcmp(cmds[i], "}") == 0)
+    {
+      printf("Unmatched '%s'\n", cmds[i]);
+      return -1;
+    }
+
+    int ret;
+    if (is_json_mode)
+    {
+      ret = exec_cmd_json(cmds[i]);
+    }
+    else
+    {
+      char *str = strdup(cmds[i]);
+      ret = exec_cmd(str);
+      free(str);
+    }
+    if (ret < 0)
+    {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Run the script line by line as it arrives, so that a program driving
+ * sdb through a pipe gets the reply of each command before sending the
+ * next one. Only the lines inside a `repeat' block are buffered until
+ * the block is closed.
+ */
+static void sdb_run_script(FILE *fp)
+{
+  char *line = NULL;
+  size_t size = 0;
+  char **cmds = NULL;
+  int n = 0, depth = 0;
+  bool quit = false;
+  while (!quit)
+  {
+    bool eof = (getline(&line, &size, fp) < 0);
+    if (!eof)
     {
-      if (strcmp(cmd, cmd_table[i].name) == 0)
+      int nr;
+      char **list = split_script(line, &nr);
+      if (nr > 0)
+      {
+        cmds = realloc(cmds, sizeof(char *) * (n + nr));
+      }
+      for (int i = 0; i < nr; i++)
       {
-        if (cmd_table[i].handler(args) < 0)
+        if (strcmp(list[i], "{") == 0)
+        {
+          depth++;
+        }
+        else if (strcmp(list[i], "}") == 0)
         {
-          return;
+          depth--;
         }
-        break;
+        cmds[n++] = list[i];
       }
+      free(list);
     }
+    /* wait for the rest of an open block, or the block after `repeat' */
+    bool complete = (depth <= 0 && (n == 0 || !is_repeat(cmds[n - 1])));
+    if (complete || eof)
+    {
+      quit = (run_script(cmds, 0, n) < 0) || eof;
+      fflush(stdout);
+      for (int i = 0; i < n; i++)
+      {
+        free(cmds[i]);
+      }
+      n = 0;
+      depth = 0;
+    }
+  }
+  free(cmds);
+  free(line);
+}
 
-    if (i == NR_CMD)
+void sdb_mainloop()
+{
+  if (gdb_target != NULL)
+  {
+    gdb_mainloop(gdb_target);
+    return;
+  }
+
+  if (script_file != NULL)
+  {
+    FILE *fp = fopen(script_file, "r");
+    Assert(fp, "Can not open script '%s'", script_file);
+    sdb_run_script(fp);
+    fclose(fp);
+    return;
+  }
+
+  if (is_batch_mode)
+  {
+    cmd_c(NULL);
+    return;
+  }
+
+  /* commands piped from another program need no line editing */
+  if (!isatty(STDIN_FILENO))
+  {
+    sdb_run_script(stdin);
+    return;
+  }
+
+  for (char *str; (str = rl_gets()) != NULL;)
+  {
+    if (exec_cmd(str) < 0)
     {
-      printf("Unknown command '%s'\n", cmd);
+      return;
     }
   }
 }
 
 void init_sdb()
 {
-  /* Compile the regular expressions. */
-  init_regex();
-
   /* Initialize the watchpoint pool. */
   init_wp_pool();
 }
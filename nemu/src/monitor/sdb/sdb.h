@@ -20,4 +20,79 @@
 
 word_t expr(char *e, bool *success);
 
+/* An expression compiled into reverse polish notation. Registers are
+ * resolved to their storage when compiling, so evaluating it only walks
+ * the ops with a small stack. */
+enum
+{
+  // push a value
+  OP_NUM,
+  OP_REG,
+  OP_REG_NAME,
+  // unary, replace the top
+  OP_NEG,
+  OP_NOT,
+  OP_BNOT,
+  OP_DEREF,
+  OP_BOOL,
+  // binary, pop two and push the result
+  OP_MUL,
+  OP_DIV,
+  OP_MOD,
+  OP_ADD,
+  OP_SUB,
+  OP_SHL,
+  OP_SHR,
+  OP_LT,
+  OP_LE,
+  OP_GT,
+  OP_GE,
+  OP_EQ,
+  OP_NE,
+  OP_AND,
+  OP_XOR,
+  OP_OR,
+  // short circuit, jump to target keeping the top, otherwise pop it
+  OP_LAND,
+  OP_LOR,
+};
+
+typedef struct
+{
+  int op;
+  union
+  {
+    word_t num;        // OP_NUM
+    const word_t *reg; // OP_REG
+    char *name;        // OP_REG_NAME, the register is read by isa_reg_str2val()
+    int target;        // OP_LAND, OP_LOR
+  };
+} ExprOp;
+
+typedef struct
+{
+  ExprOp *code;
+  int len;
+  int depth; // the deepest stack needed
+} ExprCode;
+
+bool expr_compile(char *e, ExprCode *c);
+word_t expr_eval(const ExprCode *c, bool *success);
+void expr_free(ExprCode *c);
+
+int new_sdb_no();
+bool delete_breakpoint(int no);
+
+// used by the gdb stub
+int add_breakpoint(vaddr_t pc);
+bool delete_breakpoint_at(vaddr_t pc);
+bool breakpoint_hit();
+bool watchpoint_hit();
+int add_data_wp(paddr_t addr, int len);
+bool delete_data_wp_at(paddr_t addr, int len);
+bool data_wp_hit(paddr_t *addr);
+
+// used by reverse execution
+void resync_watchpoint();
+
 #endif
@@ -12,7 +12,7 @@
  *
  * See the Mulan PSL v2 for more details.
  ***************************************************************************************/
-#include <common.h>
+#include <isa.h>
 #include "sdb.h"
 
 #define NR_WP 32
@@ -21,7 +21,9 @@ typedef struct watchpoint
 {
   int NO;
   char expr[128];
+  ExprCode code; // compiled once in cmd_w()
   word_t old_val;
+  bool failed; // the last evaluation failed, warned only once
   struct watchpoint *next;
 
   /* done for the first time at 2025.12.27 ——shuimushi*/
@@ -31,7 +33,33 @@ typedef struct watchpoint
 
 static WP wp_pool[NR_WP] = {};
 static WP *head = NULL, *free_ = NULL;
-#include <common.h>
+static bool wp_stopped = false;
+
+/* Data watchpoints only watch a range of physical memory. They are kept
+ * in an interval set and checked by paddr_write() and mmio_write(), so
+ * they cost nothing per instruction. */
+typedef struct data_watchpoint
+{
+  int NO;
+  paddr_t addr;
+  int len;
+  struct data_watchpoint *next;
+} DWP;
+
+static DWP *dwp_head = NULL;
+static IntervalSet dwp_set = {};
+int nr_data_wp = 0;
+static bool dwp_hit = false;
+static paddr_t dwp_hit_addr = 0;
+
+// watchpoints, data watchpoints and breakpoints share the numbers
+static int wp_no_counter = 1;
+
+int new_sdb_no()
+{
+  return wp_no_counter++;
+}
+
 WP *new_wp();
 void free_wp(WP *wp);
 bool scan_watchpoint();
@@ -59,6 +87,7 @@ WP *new_wp()
   head = wp;
   // Reset the node data to avoid dirty data
   wp->old_val = 0;
+  wp->failed = false;
   memset(wp->expr, 0, sizeof(wp->expr));
   return wp;
 }
@@ -86,6 +115,7 @@ void free_wp(WP *wp)
     // Remove 'wp' from the link
     prev->next = wp->next;
   }
+  expr_free(&wp->code);
   // Return the node to 'free_'list
   wp->next = free_;
   free_ = wp;
@@ -97,14 +127,20 @@ bool scan_watchpoint()
   while (p)
   {
     bool success;
-    // Evaluate the expression
-    word_t new_val = expr(p->expr, &success);
+    // Evaluate the compiled expression
+    word_t new_val = expr_eval(&p->code, &success);
     if (!success)
     {
-      // Note:If success is false,you might want to handle the error or ignore it.
-      printf("Warning: Watchpoint %d expression evaluation failed!\n", p->NO);
-      return false;
+      // skip it until it can be evaluated again, and check the others
+      if (!p->failed)
+      {
+        printf("Warning: Watchpoint %d expression evaluation failed!\n", p->NO);
+        p->failed = true;
+      }
+      p = p->next;
+      continue;
     }
+    p->failed = false;
     // Compare the new value with the old value
     if (new_val != p->old_val)
     {
@@ -117,8 +153,32 @@ bool scan_watchpoint()
     }
     p = p->next;
   }
+  wp_stopped |= found_change;
   return found_change;
 }
+
+// whether some watchpoint has stopped the execution since the last call
+bool watchpoint_hit()
+{
+  bool hit = wp_stopped;
+  wp_stopped = false;
+  return hit;
+}
+
+// take the current values as the old ones, after the machine is
+// restored to another point of time
+void resync_watchpoint()
+{
+  for (WP *p = head; p != NULL; p = p->next)
+  {
+    bool success;
+    word_t val = expr_eval(&p->code, &success);
+    if (success)
+    {
+      p->old_val = val;
+    }
+  }
+}
 int cmd_w(char *args)
 {
   if (args == NULL)
@@ -127,12 +187,25 @@ int cmd_w(char *args)
     return 0;
   }
 
-  // 1. Evaluate the expression
+  if (strlen(args) >= sizeof(((WP *)0)->expr))
+  {
+    printf("Error: Expression is too long.\n");
+    return 0;
+  }
+
+  // 1. Compile the expression and evaluate it
+  ExprCode code;
+  if (!expr_compile(args, &code))
+  {
+    printf("Error: Invalid expression.\n");
+    return 0;
+  }
   bool success;
-  uint32_t val = expr(args, &success);
+  word_t val = expr_eval(&code, &success);
   if (!success)
   {
-    printf("Error: Invalid expression.\n");
+    printf("Error: The expression can not be evaluated now.\n");
+    expr_free(&code);
     return 0;
   }
 
@@ -140,16 +213,69 @@ int cmd_w(char *args)
   WP *wp = new_wp();
 
   // 3. Assign ID (Simple static counter)
-  static int wp_no_counter = 1;
-  wp->NO = wp_no_counter++;
+  wp->NO = new_sdb_no();
 
   // 4. Store the expression and its current value
   strcpy(wp->expr, args);
+  wp->code = code;
   wp->old_val = val;
 
   printf("Watchpoint %d: %s\n", wp->NO, wp->expr);
   return 0;
 }
+int add_data_wp(paddr_t addr, int len)
+{
+  DWP *dp = malloc(sizeof(DWP));
+  assert(dp);
+  dp->NO = new_sdb_no();
+  dp->addr = addr;
+  dp->len = len;
+  dp->next = dwp_head;
+  dwp_head = dp;
+  intvl_add(&dwp_set, addr, (uint64_t)addr + len, dp);
+  nr_data_wp++;
+
+  printf("Data watchpoint %d: [" FMT_PADDR ", " FMT_PADDR "]\n", dp->NO, addr, addr + len - 1);
+  return dp->NO;
+}
+
+static void free_dwp(DWP **pp)
+{
+  DWP *dp = *pp;
+  intvl_del(&dwp_set, dp->addr, (uint64_t)dp->addr + dp->len, dp);
+  *pp = dp->next;
+  printf("Data watchpoint %d deleted.\n", dp->NO);
+  free(dp);
+  nr_data_wp--;
+}
+
+// the gdb stub refers to data watchpoints by their ranges
+bool delete_data_wp_at(paddr_t addr, int len)
+{
+  for (DWP **pp = &dwp_head; *pp != NULL; pp = &(*pp)->next)
+  {
+    if ((*pp)->addr == addr && (*pp)->len == len)
+    {
+      free_dwp(pp);
+      return true;
+    }
+  }
+  return false;
+}
+
+// whether some data watchpoint has stopped the execution since the
+// last call, and the address written if so
+bool data_wp_hit(paddr_t *addr)
+{
+  bool hit = dwp_hit;
+  if (hit && addr != NULL)
+  {
+    *addr = dwp_hit_addr;
+  }
+  dwp_hit = false;
+  return hit;
+}
+
 int cmd_d(char *args)
 {
   if (args == NULL)
@@ -174,12 +300,85 @@ int cmd_d(char *args)
     p = p->next;
   }
 
+  // Then the data watchpoints
+  for (DWP **pp = &dwp_head; *pp != NULL; pp = &(*pp)->next)
+  {
+    if ((*pp)->NO == no)
+    {
+      free_dwp(pp);
+      return 0;
+    }
+  }
+
+  if (delete_breakpoint(no))
+  {
+    return 0;
+  }
+
   printf("Watchpoint %d not found.\n", no);
   return 0;
 }
+int cmd_wm(char *args)
+{
+  char *arg_n = strtok(args, " ");
+  char *arg_expr = strtok(NULL, "");
+  if (arg_n == NULL || arg_expr == NULL)
+  {
+    printf("Usage: wm N EXPR\n");
+    return 0;
+  }
+
+  int len = atoi(arg_n);
+  if (len < 1)
+  {
+    printf("Error: N must be >= 1.\n");
+    return 0;
+  }
+  bool success;
+  paddr_t addr = expr(arg_expr, &success);
+  if (!success)
+  {
+    printf("Error: Invalid expression.\n");
+    return 0;
+  }
+
+  add_data_wp(addr, len);
+  return 0;
+}
+// called before a write to [addr, addr + len) when there are data watchpoints
+void check_data_wp(paddr_t addr, int len, word_t old, word_t data)
+{
+  uint64_t hi = (uint64_t)addr + len;
+  bool hit = false;
+  for (Interval *iv = intvl_find(&dwp_set, addr, hi); iv != NULL; iv = intvl_find_next(&dwp_set, addr, hi, iv))
+  {
+    DWP *dp = iv->data;
+    printf("Data watchpoint %d: [" FMT_PADDR ", " FMT_PADDR "]\n", dp->NO, dp->addr, dp->addr + dp->len - 1);
+    hit = true;
+  }
+  if (!hit)
+  {
+    return;
+  }
+
+  if (len < sizeof(word_t))
+  {
+    // only the low bytes of data are written
+    data &= ((word_t)1 << (len * 8)) - 1;
+  }
+  dwp_hit = true;
+  dwp_hit_addr = addr;
+  printf("Written by pc = " FMT_WORD " at " FMT_PADDR " with len = %d\n", cpu.pc, addr, len);
+  printf("Old value = " FMT_WORD "\n", old);
+  printf("New value = " FMT_WORD "\n", data);
+  if (nemu_state.state == NEMU_RUNNING)
+  {
+    nemu_state.state = NEMU_STOP;
+  }
+}
 void list_watchpoint()
 {
-  if (head == NULL)
+  if (head == NULL && dwp_head == NULL)
   {
     printf("No watchpoints.\n");
     return;
@@ -195,6 +394,11 @@ void list_watchpoint()
     printf("%-8d %-16s 0x%08x\n", p->NO, p->expr, p->old_val);
     p = p->next;
   }
+
+  for (DWP *dp = dwp_head; dp != NULL; dp = dp->next)
+  {
+    printf("%-8d [" FMT_PADDR ", " FMT_PADDR "]\n", dp->NO, dp->addr, dp->addr + dp->len - 1);
+  }
 }
   /* initial implement by [shuimushi] on 2025.12.27 */
   /* TODO: Implement the functionality of watchpoint */
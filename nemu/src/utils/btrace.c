@@ -0,0 +1,84 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+#include <btrace-def.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define BTRACE_BUF_SIZE (1024 * 1024)
+
+bool btrace_on = false;
+static int btrace_fd = -1;
+static uint8_t buf[BTRACE_BUF_SIZE];
+static size_t buf_len = 0;
+static uint64_t next_pc = 0;
+static uint64_t last_addr = 0;
+
+void btrace_flush() {
+  uint8_t *p = buf;
+  while (buf_len > 0) {
+    ssize_t ret = write(btrace_fd, p, buf_len);
+    Assert(ret > 0, "write to the binary trace file failed");
+    p += ret;
+    buf_len -= ret;
+  }
+}
+
+static inline uint8_t *btrace_reserve() {
+  if (unlikely(buf_len + BTRACE_REC_MAX > BTRACE_BUF_SIZE)) btrace_flush();
+  return buf + buf_len;
+}
+
+void btrace_inst(vaddr_t pc, const uint8_t *inst, int ilen) {
+  uint8_t *p = btrace_reserve();
+  *p ++ = BTRACE_TAG_INST | ilen;
+  p = btrace_put_varint(p, (int64_t)pc - (int64_t)next_pc);
+  memcpy(p, inst, ilen);
+  p += ilen;
+  buf_len = p - buf;
+  next_pc = (uint64_t)pc + ilen;
+}
+
+void btrace_mem(paddr_t addr, int len, word_t data, bool is_write) {
+  uint8_t *p = btrace_reserve();
+  int log2_len = (len == 1 ? 0 : len == 2 ? 1 : len == 4 ? 2 : 3);
+  *p ++ = BTRACE_TAG_MEM | (is_write ? BTRACE_MEM_WRITE : 0) | log2_len;
+  p = btrace_put_varint(p, (int64_t)addr - (int64_t)last_addr);
+  uint64_t d = data;
+  for (int i = 0; i < len; i ++) { *p ++ = d & 0xff; d >>= 8; }
+  buf_len = p - buf;
+  last_addr = addr;
+}
+
+static void btrace_exit() {
+  btrace_flush();
+  close(btrace_fd);
+}
+
+void init_btrace(const char *btrace_file) {
+  if (btrace_file == NULL) return;
+  btrace_fd = open(btrace_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  Assert(btrace_fd >= 0, "Can not open '%s'", btrace_file);
+
+  BTraceHeader h = { .magic = BTRACE_MAGIC, .isa = str(__GUEST_ISA__),
+    .version = BTRACE_VERSION, .word_size = sizeof(word_t) };
+  memcpy(buf, &h, sizeof(h));
+  buf_len = sizeof(h);
+  btrace_on = true;
+  atexit(btrace_exit);
+  Log("Binary trace is written to %s", btrace_file);
+}
@@ -30,8 +30,9 @@ static size_t (*cs_disasm_dl)(csh handle, const uint8_t *code,
 static void (*cs_free_dl)(cs_insn *insn, size_t count);
 
 static csh handle;
+static bool disasm_ready = false;
 
-void init_disasm() {
+static void init_disasm() {
   void *dl_handle;
   dl_handle = dlopen("tools/capstone/repo/libcapstone." CS_LIB_SUFFIX, RTLD_LAZY);
   assert(dl_handle);
@@ -65,15 +66,117 @@ void init_disasm() {
   ret = cs_option_dl(handle, CS_OPT_SYNTAX, CS_OPT_SYNTAX_ATT);
   assert(ret == CS_ERR_OK);
 #endif
+  disasm_ready = true;
 }
 
-void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte) {
-	cs_insn *insn;
-	size_t count = cs_disasm_dl(handle, code, nbyte, pc, 0, &insn);
-  assert(count == 1);
+static void cs_disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte) {
+  cs_insn *insn;
+  size_t count = cs_disasm_dl(handle, code, nbyte, pc, 0, &insn);
+  if (count != 1) {
+    // undecodable bytes, e.g. the invalid instruction which aborts NEMU
+    int ret = snprintf(str, size, ".word\t0x");
+#ifdef CONFIG_ISA_x86
+    for (int i = 0; i < nbyte; i ++) {
+#else
+    for (int i = nbyte - 1; i >= 0; i --) {
+#endif
+      ret += snprintf(str + ret, size - ret, "%02x", code[i]);
+    }
+    if (count > 0) cs_free_dl(insn, count);
+    return;
+  }
   int ret = snprintf(str, size, "%s", insn->mnemonic);
   if (insn->op_str[0] != '\0') {
     snprintf(str + ret, size - ret, "\t%s", insn->op_str);
   }
   cs_free_dl(insn, count);
 }
+
+/* The formatted text of an instruction only depends on its bytes, unless it
+ * refers to its pc (e.g. branches). An entry in the first table remembers
+ * whether the text depends on the pc. If it does, the text is looked up
+ * again in the second table, which is also keyed by the pc. */
+#define DISASM_CACHE_SIZE 4096
+#define DISASM_ILEN_MAX 16
+#define DISASM_STR_LEN 96
+
+typedef struct {
+  uint64_t pc;
+  uint8_t code[DISASM_ILEN_MAX];
+  uint8_t nbyte;
+  bool pc_rel;
+  char str[DISASM_STR_LEN];
+} DisasmEntry;
+
+static DisasmEntry cache[DISASM_CACHE_SIZE];
+static DisasmEntry cache_pc_rel[DISASM_CACHE_SIZE];
+
+static inline uint32_t disasm_hash(uint8_t *code, int nbyte, uint64_t pc) {
+  uint64_t h = 0xcbf29ce484222325ull ^ pc;
+  for (int i = 0; i < nbyte; i ++) { h = (h ^ code[i]) * 0x100000001b3ull; }
+  return (h ^ (h >> 32)) % DISASM_CACHE_SIZE;
+}
+
+static inline bool disasm_match(DisasmEntry *e, uint8_t *code, int nbyte, uint64_t pc) {
+  return e->nbyte == nbyte && e->pc == pc && memcmp(e->code, code, nbyte) == 0;
+}
+
+static inline void disasm_fill(DisasmEntry *e, uint8_t *code, int nbyte, uint64_t pc) {
+  e->pc = pc;
+  e->nbyte = nbyte;
+  memcpy(e->code, code, nbyte);
+}
+
+void disassemble(char *str, int size, uint64_t pc, uint8_t *code, int nbyte) {
+  if (unlikely(!disasm_ready)) init_disasm();
+  if (nbyte > DISASM_ILEN_MAX) {
+    cs_disassemble(str, size, pc, code, nbyte);
+    return;
+  }
+
+  DisasmEntry *e = &cache[disasm_hash(code, nbyte, 0)];
+  if (!disasm_match(e, code, nbyte, 0)) {
+    // disassemble at another pc to find out whether the text depends on the pc
+    char other[DISASM_STR_LEN];
+    cs_disassemble(e->str, sizeof(e->str), pc, code, nbyte);
+    cs_disassemble(other, sizeof(other), pc + 0x1000, code, nbyte);
+    disasm_fill(e, code, nbyte, 0);
+    e->pc_rel = (strcmp(e->str, other) != 0);
+    if (e->pc_rel) {
+      DisasmEntry *r = &cache_pc_rel[disasm_hash(code, nbyte, pc)];
+      disasm_fill(r, code, nbyte, pc);
+      strcpy(r->str, e->str);
+    }
+  }
+
+  if (e->pc_rel) {
+    e = &cache_pc_rel[disasm_hash(code, nbyte, pc)];
+    if (!disasm_match(e, code, nbyte, pc)) {
+      cs_disassemble(e->str, sizeof(e->str), pc, code, nbyte);
+      disasm_fill(e, code, nbyte, pc);
+    }
+  }
+  snprintf(str, size, "%s", e->str);
+}
+
+// format an instruction in the same way as the instruction tracer
+void itrace_format(char *str, int size, vaddr_t pc, uint8_t *inst, int ilen) {
+  char *p = str;
+  p += snprintf(p, size, FMT_WORD ":", pc);
+  int i;
+#ifdef CONFIG_ISA_x86
+  for (i = 0; i < ilen; i ++) {
+#else
+  for (i = ilen - 1; i >= 0; i --) {
+#endif
+    p += snprintf(p, 4, " %02x", inst[i]);
+  }
+  int ilen_max = MUXDEF(CONFIG_ISA_x86, 8, 4);
+  int space_len = ilen_max - ilen;
+  if (space_len < 0) space_len = 0;
+  space_len = space_len * 3 + 1;
+  memset(p, ' ', space_len);
+  p += space_len;
+
+  disassemble(p, str + size - p, MUXDEF(CONFIG_ISA_x86, pc + ilen, pc), inst, ilen);
+}
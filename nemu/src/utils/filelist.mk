@@ -13,6 +13,20 @@
 # See the Mulan PSL v2 for more details.
 #**************************************************************************************/
 
+SRCS-BLACKLIST-$(CONFIG_TARGET_AM) += src/utils/intvl.c
+
+ifndef CONFIG_BTRACE
+SRCS-BLACKLIST-y += src/utils/btrace.c
+endif
+
+ifndef CONFIG_MTRACE
+SRCS-BLACKLIST-y += src/utils/mtrace.c
+endif
+
+ifndef CONFIG_IQUEUE
+SRCS-BLACKLIST-y += src/utils/iqueue.c
+endif
+
 ifeq ($(CONFIG_ITRACE)$(CONFIG_IQUEUE),)
 SRCS-BLACKLIST-y += src/utils/disasm.c
 else
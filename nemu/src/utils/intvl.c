@@ -0,0 +1,77 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+
+static void intvl_update_max(IntervalSet *s, int from) {
+  for (int i = from; i < s->n; i ++) {
+    uint64_t prev = (i == 0 ? 0 : s->max_hi[i - 1]);
+    s->max_hi[i] = (s->iv[i].hi > prev ? s->iv[i].hi : prev);
+  }
+}
+
+void intvl_add(IntervalSet *s, uint64_t lo, uint64_t hi, void *data) {
+  assert(lo < hi);
+  if (s->n == s->cap) {
+    s->cap = (s->cap == 0 ? 8 : s->cap * 2);
+    s->iv = realloc(s->iv, sizeof(s->iv[0]) * s->cap);
+    s->max_hi = realloc(s->max_hi, sizeof(s->max_hi[0]) * s->cap);
+    assert(s->iv && s->max_hi);
+  }
+  int i = s->n;
+  while (i > 0 && s->iv[i - 1].lo > lo) { s->iv[i] = s->iv[i - 1]; i --; }
+  s->iv[i] = (Interval){ .lo = lo, .hi = hi, .data = data };
+  s->n ++;
+  intvl_update_max(s, i);
+}
+
+bool intvl_del(IntervalSet *s, uint64_t lo, uint64_t hi, void *data) {
+  for (int i = 0; i < s->n; i ++) {
+    if (s->iv[i].lo == lo && s->iv[i].hi == hi && s->iv[i].data == data) {
+      memmove(&s->iv[i], &s->iv[i + 1], sizeof(s->iv[0]) * (s->n - i - 1));
+      s->n --;
+      intvl_update_max(s, i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// return one of the intervals overlapping with [lo, hi), or NULL if there is none
+Interval* intvl_find(IntervalSet *s, uint64_t lo, uint64_t hi) {
+  return intvl_find_next(s, lo, hi, NULL);
+}
+
+// return the next interval overlapping with [lo, hi) after `prev', which
+// is returned by a previous call, or NULL to start from the beginning
+Interval* intvl_find_next(IntervalSet *s, uint64_t lo, uint64_t hi, Interval *prev) {
+  int l = 0;
+  if (prev != NULL) l = prev - s->iv;
+  else {
+    // find the last interval starting before hi
+    int r = s->n;
+    while (l < r) {
+      int mid = (l + r) / 2;
+      if (s->iv[mid].lo < hi) l = mid + 1;
+      else r = mid;
+    }
+  }
+  // intervals before it can only overlap if they end after lo
+  for (int i = l - 1; i >= 0 && s->max_hi[i] > lo; i --) {
+    if (s->iv[i].hi > lo) return &s->iv[i];
+  }
+  return NULL;
+}
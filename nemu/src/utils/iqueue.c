@@ -0,0 +1,33 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+#include <cpu/iqueue.h>
+
+IQueueEntry iqueue[CONFIG_IQUEUE_SIZE] = {};
+int iqueue_idx = 0;
+
+void itrace_format(char *str, int size, vaddr_t pc, uint8_t *inst, int ilen);
+
+void iqueue_dump() {
+  char buf[128];
+  int last = (iqueue_idx == 0 ? CONFIG_IQUEUE_SIZE : iqueue_idx) - 1;
+  printf("Latest instructions (the last one is marked by '-->'):\n");
+  for (int n = 0, i = iqueue_idx; n < CONFIG_IQUEUE_SIZE; n ++, i = (i + 1) % CONFIG_IQUEUE_SIZE) {
+    IQueueEntry *e = &iqueue[i];
+    if (e->ilen == 0) continue; // not filled yet
+    itrace_format(buf, sizeof(buf), e->pc, e->inst, e->ilen);
+    printf("%s %s\n", (i == last ? "-->" : "   "), buf);
+  }
+}
@@ -0,0 +1,55 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+#include <common.h>
+#include <memory/paddr.h>
+
+bool mtrace_on = false;
+static IntervalSet ranges = {};
+static uint64_t sample = 1, sample_cnt = 0;
+
+// only called when mtrace is on, see MTRACE() in memory/paddr.h
+void mtrace_access(paddr_t addr, int len, word_t data, bool is_write) {
+  if (!btrace_enable()) return;
+  if (intvl_find(&ranges, addr, (uint64_t)addr + len) == NULL) return;
+  if (++ sample_cnt < sample) return;
+  sample_cnt = 0;
+  btrace_mem(addr, len, data, is_write);
+}
+
+// ranges are given as "LO-HI[,LO-HI...]" in hex, where HI is excluded
+void init_mtrace(const char *range_str, int sample_rate) {
+  if (range_str == NULL) return;
+  extern bool btrace_on;
+  if (!btrace_on) {
+    Log("mtrace is ignored since there is no binary trace file (--btrace)");
+    return;
+  }
+  const char *p = range_str;
+  while (*p != '\0') {
+    uint64_t lo, hi;
+    int n;
+    Assert(sscanf(p, "%" SCNx64 "-%" SCNx64 "%n", &lo, &hi, &n) == 2 && lo < hi,
+        "Invalid mtrace range '%s'", p);
+    intvl_add(&ranges, lo, hi, NULL);
+    Log("mtrace [0x%" PRIx64 ", 0x%" PRIx64 ")", lo, hi);
+    p += n;
+    if (*p == ',') p ++;
+  }
+  sample = (sample_rate > 0 ? sample_rate : 1);
+  if (sample > 1) Log("mtrace samples 1 in %" PRIu64 " accesses", sample);
+  mtrace_on = true;
+}
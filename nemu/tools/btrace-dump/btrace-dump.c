@@ -0,0 +1,263 @@
+/***************************************************************************************
+* Copyright (c) 2014-2024 Zihao Yu, Nanjing University
+*
+* NEMU is licensed under Mulan PSL v2.
+* You can use this software according to the terms and conditions of the Mulan PSL v2.
+* You may obtain a copy of Mulan PSL v2 at:
+*          http://license.coscl.org.cn/MulanPSL2
+*
+* THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+* EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+* MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+*
+* See the Mulan PSL v2 for more details.
+***************************************************************************************/
+
+
+/* Decode a binary trace written by NEMU with --btrace.
+ * The trace is cut into chunks which are disassembled by several threads,
+ * and the text of the instruction records is identical to the output of
+ * the instruction tracer (itrace).
+ */
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <capstone/capstone.h>
+#include <btrace-def.h>
+
+#define CHUNK_NR_REC (64 * 1024)
+#define MAX_THREAD 64
+
+static size_t (*cs_disasm_dl)(csh handle, const uint8_t *code,
+    size_t code_size, uint64_t address, size_t count, cs_insn **insn);
+static void (*cs_free_dl)(cs_insn *insn, size_t count);
+static cs_err (*cs_open_dl)(cs_arch arch, cs_mode mode, csh *handle);
+static cs_err (*cs_option_dl)(csh handle, cs_opt_type type, size_t value);
+
+static const uint8_t *trace, *trace_end;
+static BTraceHeader hdr;
+static bool is_x86 = false;
+static uint64_t pc_lo = 0, pc_hi = UINT64_MAX;
+static bool show_mem = true;
+static int nr_thread = 0;
+
+typedef struct {
+  const uint8_t *begin, *end;
+  uint64_t next_pc, last_addr; // decoder state at the beginning
+  char *out;
+  size_t out_len;
+  csh handle;
+} Chunk;
+
+static void init_capstone(csh *handle) {
+  cs_arch arch = -1;
+  cs_mode mode = -1;
+  if (strcmp(hdr.isa, "x86") == 0) { arch = CS_ARCH_X86; mode = CS_MODE_32; }
+  else if (strcmp(hdr.isa, "mips32") == 0) { arch = CS_ARCH_MIPS; mode = CS_MODE_MIPS32; }
+  else if (strcmp(hdr.isa, "riscv32") == 0) { arch = CS_ARCH_RISCV; mode = CS_MODE_RISCV32 | CS_MODE_RISCVC; }
+  else if (strcmp(hdr.isa, "riscv64") == 0) { arch = CS_ARCH_RISCV; mode = CS_MODE_RISCV64 | CS_MODE_RISCVC; }
+  else if (strcmp(hdr.isa, "loongarch32r") == 0) { arch = CS_ARCH_LOONGARCH; mode = CS_MODE_LOONGARCH32; }
+  else { fprintf(stderr, "Unsupported ISA '%s'\n", hdr.isa); exit(1); }
+  int ret = cs_open_dl(arch, mode, handle);
+  assert(ret == CS_ERR_OK);
+  if (is_x86) {
+    ret = cs_option_dl(*handle, CS_OPT_SYNTAX, CS_OPT_SYNTAX_ATT);
+    assert(ret == CS_ERR_OK);
+  }
+}
+
+static void load_capstone() {
+  void *dl_handle = dlopen(CS_LIB_PATH, RTLD_LAZY);
+  if (dl_handle == NULL) { fprintf(stderr, "Can not load %s\n", CS_LIB_PATH); exit(1); }
+  cs_open_dl = dlsym(dl_handle, "cs_open");
+  cs_option_dl = dlsym(dl_handle, "cs_option");
+  cs_disasm_dl = dlsym(dl_handle, "cs_disasm");
+  cs_free_dl = dlsym(dl_handle, "cs_free");
+  assert(cs_open_dl && cs_option_dl && cs_disasm_dl && cs_free_dl);
+}
+
+// keep the same format as itrace_format() in NEMU
+static void format_inst(FILE *fp, csh handle, uint64_t pc, const uint8_t *inst, int ilen) {
+  if (hdr.word_size == 8) fprintf(fp, "0x%016" PRIx64 ":", pc);
+  else fprintf(fp, "0x%08" PRIx32 ":", (uint32_t)pc);
+  if (is_x86) { for (int i = 0; i < ilen; i ++) fprintf(fp, " %02x", inst[i]); }
+  else { for (int i = ilen - 1; i >= 0; i --) fprintf(fp, " %02x", inst[i]); }
+  int space_len = (is_x86 ? 8 : 4) - ilen;
+  if (space_len < 0) space_len = 0;
+  fprintf(fp, "%*s", space_len * 3 + 1, "");
+
+  cs_insn *insn;
+  size_t count = cs_disasm_dl(handle, inst, ilen, is_x86 ? pc + ilen : pc, 0, &insn);
+  if (count != 1) {
+    fprintf(fp, ".word\t0x");
+    if (is_x86) { for (int i = 0; i < ilen; i ++) fprintf(fp, "%02x", inst[i]); }
+    else { for (int i = ilen - 1; i >= 0; i --) fprintf(fp, "%02x", inst[i]); }
+    fprintf(fp, "\n");
+    if (count > 0) cs_free_dl(insn, count);
+    return;
+  }
+  fprintf(fp, "%s", insn->mnemonic);
+  if (insn->op_str[0] != '\0') fprintf(fp, "\t%s", insn->op_str);
+  fprintf(fp, "\n");
+  cs_free_dl(insn, count);
+}
+
+static void bad_trace(const uint8_t *p) {
+  fprintf(stderr, "Malformed record at offset %zu\n", (size_t)(p - trace));
+  exit(1);
+}
+
+/* Walk through the records in [p, end). The state is updated in place.
+ * Return the position after the last record walked through. When fp is
+ * not NULL, the records are printed, otherwise at most nr_rec records
+ * are skipped to find the boundary of a chunk. */
+static const uint8_t *walk(const uint8_t *p, const uint8_t *end, uint64_t *next_pc,
+    uint64_t *last_addr, FILE *fp, csh handle, long nr_rec) {
+  // memory records come before their instruction, so hold them until then
+  const uint8_t *mem_begin = NULL;
+  uint64_t mem_addr = *last_addr;
+  while (p < end && nr_rec != 0) {
+    const uint8_t *rec = p;
+    uint8_t tag = *p ++;
+    int64_t delta;
+    p = btrace_get_varint(p, end, &delta);
+    if (p == NULL) bad_trace(rec);
+    if ((tag & BTRACE_TAG_MASK) == BTRACE_TAG_INST) {
+      int ilen = tag & 0xf;
+      uint64_t pc = *next_pc + delta;
+      if (hdr.word_size == 4) pc = (uint32_t)pc;
+      if (ilen == 0 || p + ilen > end) bad_trace(rec);
+      if (fp != NULL && pc >= pc_lo && pc < pc_hi) {
+        format_inst(fp, handle, pc, p, ilen);
+        for (const uint8_t *q = mem_begin; q != NULL && q < rec; ) {
+          uint8_t mtag = *q ++;
+          int64_t d = 0;
+          q = btrace_get_varint(q, rec, &d);
+          mem_addr += d;
+          int len = 1 << (mtag & 0x3);
+          uint64_t data = 0;
+          for (int i = len - 1; i >= 0; i --) data = (data << 8) | q[i];
+          q += len;
+          if (show_mem) {
+            fprintf(fp, "  %s " "0x%08" PRIx64 " %d 0x%0*" PRIx64 "\n",
+                (mtag & BTRACE_MEM_WRITE ? "mem write" : "mem read "), mem_addr, len, len * 2, data);
+          }
+        }
+      }
+      p += ilen;
+      *next_pc = pc + ilen;
+      mem_begin = NULL;
+      mem_addr = *last_addr;
+      nr_rec --;
+    } else if ((tag & BTRACE_TAG_MASK) == BTRACE_TAG_MEM) {
+      int len = 1 << (tag & 0x3);
+      if (p + len > end) bad_trace(rec);
+      if (mem_begin == NULL) mem_begin = rec;
+      *last_addr += delta;
+      p += len;
+    } else {
+      bad_trace(rec);
+    }
+  }
+  return p;
+}
+
+static void *worker(void *arg) {
+  Chunk *c = arg;
+  FILE *fp = open_memstream(&c->out, &c->out_len);
+  assert(fp);
+  walk(c->begin, c->end, &c->next_pc, &c->last_addr, fp, c->handle, -1);
+  fclose(fp);
+  return NULL;
+}
+
+static void usage(const char *name) {
+  printf("Usage: %s [OPTION...] TRACE_FILE\n\n", name);
+  printf("\t-j,--jobs=N             decode with N threads (default: number of cores)\n");
+  printf("\t-r,--range=LO:HI        only print instructions with LO <= pc < HI\n");
+  printf("\t-n,--no-mem             do not print memory access records\n");
+  printf("\n");
+  exit(0);
+}
+
+int main(int argc, char *argv[]) {
+  const struct option table[] = {
+    {"jobs"     , required_argument, NULL, 'j'},
+    {"range"    , required_argument, NULL, 'r'},
+    {"no-mem"   , no_argument      , NULL, 'n'},
+    {"help"     , no_argument      , NULL, 'h'},
+    {0          , 0                , NULL,  0 },
+  };
+  const char *file = NULL;
+  int o;
+  while ( (o = getopt_long(argc, argv, "-hj:r:n", table, NULL)) != -1) {
+    switch (o) {
+      case 'j': nr_thread = atoi(optarg); break;
+      case 'r':
+        if (sscanf(optarg, "%" SCNx64 ":%" SCNx64, &pc_lo, &pc_hi) != 2) usage(argv[0]);
+        break;
+      case 'n': show_mem = false; break;
+      case 1: file = optarg; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (file == NULL) usage(argv[0]);
+  if (nr_thread <= 0) nr_thread = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nr_thread > MAX_THREAD) nr_thread = MAX_THREAD;
+
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) { perror(file); return 1; }
+  struct stat st;
+  fstat(fd, &st);
+  if (st.st_size < sizeof(BTraceHeader)) { fprintf(stderr, "%s is too short\n", file); return 1; }
+  trace = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  assert(trace != MAP_FAILED);
+  trace_end = trace + st.st_size;
+  madvise((void *)trace, st.st_size, MADV_SEQUENTIAL);
+
+  memcpy(&hdr, trace, sizeof(hdr));
+  if (memcmp(hdr.magic, BTRACE_MAGIC, sizeof(BTRACE_MAGIC)) != 0 || hdr.version != BTRACE_VERSION) {
+    fprintf(stderr, "%s is not a binary trace of this version\n", file);
+    return 1;
+  }
+  hdr.isa[sizeof(hdr.isa) - 1] = '\0';
+  is_x86 = (strcmp(hdr.isa, "x86") == 0);
+
+  load_capstone();
+  static Chunk chunk[MAX_THREAD];
+  for (int i = 0; i < nr_thread; i ++) init_capstone(&chunk[i].handle);
+
+  const uint8_t *p = trace + sizeof(BTraceHeader);
+  uint64_t next_pc = 0, last_addr = 0;
+  pthread_t tid[MAX_THREAD];
+  while (p < trace_end) {
+    // cut the trace into chunks sequentially, then decode them in parallel
+    int n;
+    for (n = 0; n < nr_thread && p < trace_end; n ++) {
+      Chunk *c = &chunk[n];
+      c->begin = p;
+      c->next_pc = next_pc;
+      c->last_addr = last_addr;
+      p = walk(p, trace_end, &next_pc, &last_addr, NULL, 0, CHUNK_NR_REC);
+      c->end = p;
+      pthread_create(&tid[n], NULL, worker, c);
+    }
+    for (int i = 0; i < n; i ++) {
+      pthread_join(tid[i], NULL);
+      fwrite(chunk[i].out, 1, chunk[i].out_len, stdout);
+      free(chunk[i].out);
+    }
+  }
+  return 0;
+}
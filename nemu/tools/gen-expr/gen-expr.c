@@ -18,11 +18,22 @@
 #include <time.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 // 缓冲区定义
 static char buf[65536] = {};
 static int buf_pos = 0;
 
+// only used in batch mode, see `checked_code' below:
+// cbuf holds one enum constant for every number and operator of the
+// expression, and bbuf tells whether any of the operators is undefined
+static char cbuf[65536 * 16] = {};
+static int cbuf_pos = 0;
+static char bbuf[65536 * 16] = {};
+static int bbuf_pos = 0;
+static int nr_node = 0;
+
 static char code_buf[65536 + 128] = {};
 static char *code_format =
     "#include <stdio.h>\n"
@@ -32,6 +43,20 @@ static char *code_format =
     "  return 0; "
     "}";
 
+/* In batch mode, thousands of expressions are compiled in one translation
+ * unit. Every subexpression becomes an enum constant, so gcc only folds
+ * constants and does not generate code for them. Division by zero and signed
+ * overflow are undefined behavior: the checked macros below tell whether an
+ * operator hits them, and such expressions are dropped. gcc wraps around on
+ * overflow when folding, and D() gives 0 instead of failing to compile. */
+static char *checked_code =
+    "#include <stdio.h>\n"
+    "#define D(a, b) (D_BAD(a, b) ? 0 : (a) / (b))\n"
+    "#define A_BAD(a, b) __builtin_add_overflow_p(a, b, 0)\n"
+    "#define S_BAD(a, b) __builtin_sub_overflow_p(a, b, 0)\n"
+    "#define M_BAD(a, b) __builtin_mul_overflow_p(a, b, 0)\n"
+    "#define D_BAD(a, b) ((b) == 0 || ((a) == -2147483647 - 1 && (b) == -1))\n";
+
 static void gen(char *str)
 {
   int len = strlen(str);
@@ -41,6 +66,11 @@ static void gen(char *str)
   buf_pos += len;
 }
 
+#define cgen(...) (cbuf_pos += snprintf(cbuf + cbuf_pos, sizeof(cbuf) - cbuf_pos, __VA_ARGS__), \
+                   assert(cbuf_pos < sizeof(cbuf)))
+#define bgen(...) (bbuf_pos += snprintf(bbuf + bbuf_pos, sizeof(bbuf) - bbuf_pos, __VA_ARGS__), \
+                   assert(bbuf_pos < sizeof(bbuf)))
+
 static void gen_num()
 {
   char str[32];
@@ -93,24 +123,216 @@ static void gen_rand_expr()
   }
 }
 
+/* In batch mode, the expression in buf is parsed again with the precedence
+ * of C, and every number and operator becomes a node, i.e. an enum constant
+ * n<N> in cbuf. Each function returns the node holding its value. */
+static char *parse_pos;
+static int parse_expr();
+
+static int parse_factor()
+{
+  if (*parse_pos == '(')
+  {
+    parse_pos++;
+    int n = parse_expr();
+    assert(*parse_pos == ')');
+    parse_pos++;
+    return n;
+  }
+  int num = strtol(parse_pos, &parse_pos, 10);
+  cgen(", n%d = %d", nr_node, num);
+  return nr_node++;
+}
+
+static int parse_binary(int (*parse_operand)(), char op1, char op2)
+{
+  int l = parse_operand();
+  while (*parse_pos == op1 || *parse_pos == op2)
+  {
+    char op = *parse_pos++;
+    int r = parse_operand();
+    if (op == '/')
+      cgen(", n%d = D(n%d, n%d)", nr_node, l, r);
+    else
+      cgen(", n%d = n%d %c n%d", nr_node, l, op, r);
+    bgen(" | %c_BAD(n%d, n%d)", (op == '+' ? 'A' : op == '-' ? 'S' : op == '*' ? 'M' : 'D'), l, r);
+    l = nr_node++;
+  }
+  return l;
+}
+
+static int parse_term()
+{
+  return parse_binary(parse_factor, '*', '/');
+}
+
+static int parse_expr()
+{
+  return parse_binary(parse_term, '+', '-');
+}
+
+static void gen_one()
+{
+  buf_pos = 0;
+  gen_rand_expr();
+  buf[buf_pos] = '\0';
+}
+
+// return the node holding the value of buf
+static int gen_checked()
+{
+  cbuf_pos = 0;
+  bbuf_pos = 0;
+  cbuf[0] = bbuf[0] = '\0';
+  parse_pos = buf;
+  int root = parse_expr();
+  assert(*parse_pos == '\0');
+  return root;
+}
+
+// run a command without the shell, and return its pid
+static pid_t spawn(char *const argv[])
+{
+  fflush(stdout);
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0)
+  {
+    execvp(argv[0], argv);
+    perror(argv[0]);
+    _exit(127);
+  }
+  return pid;
+}
+
+/* Write the expressions in chunks of `chunk', each chunk is a translation
+ * unit with a table of the values and a table driven main. All chunks
+ * are compiled in parallel, then run in order to print the expressions
+ * which do not hit undefined behavior, in the format of input.txt. */
+static void batch(int loop, int chunk)
+{
+  char dir[] = "/tmp/gen-expr.XXXXXX";
+  assert(mkdtemp(dir) != NULL);
+  int nr_chunk = (loop + chunk - 1) / chunk;
+  char path[128];
+
+  for (int k = 0; k < nr_chunk; k++)
+  {
+    snprintf(path, sizeof(path), "%s/%d.c", dir, k);
+    FILE *fp = fopen(path, "w");
+    assert(fp != NULL);
+    fputs(checked_code, fp);
+
+    // the enums go first, and the table is kept in memory until the end
+    char *tab;
+    size_t tab_size;
+    FILE *tab_fp = open_memstream(&tab, &tab_size);
+    assert(tab_fp != NULL);
+
+    int n = (loop - k * chunk < chunk ? loop - k * chunk : chunk);
+    nr_node = 0;
+    for (int i = 0; i < n; i++)
+    {
+      gen_one();
+      int root = gen_checked();
+      // d%d takes the leading ", " of cbuf
+      fprintf(fp, "enum { d%d%s };\nenum { b%d = 0%s };\n", i, cbuf, i, bbuf);
+      fprintf(tab_fp, "  { n%d, b%d, \"%s\" },\n", root, i, buf);
+    }
+    fclose(tab_fp);
+    fprintf(fp, "static const struct { int val, bad; const char *expr; } tab[] = {\n");
+    fwrite(tab, 1, tab_size, fp);
+    free(tab);
+    fprintf(fp, "};\n"
+                "int main() {\n"
+                "  for (int i = 0; i < sizeof(tab) / sizeof(tab[0]); i++) {\n"
+                "    if (!tab[i].bad) printf(\"%%u %%s\\n\", (unsigned)tab[i].val, tab[i].expr);\n"
+                "  }\n"
+                "  return 0;\n"
+                "}\n");
+    fclose(fp);
+  }
+
+  // compile with at most one job per cpu
+  long nr_job = sysconf(_SC_NPROCESSORS_ONLN);
+  int running = 0;
+  for (int k = 0; k < nr_chunk; k++)
+  {
+    if (running == nr_job)
+    {
+      int status;
+      wait(&status);
+      assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+      running--;
+    }
+    char src[128], bin[128];
+    snprintf(src, sizeof(src), "%s/%d.c", dir, k);
+    snprintf(bin, sizeof(bin), "%s/%d", dir, k);
+    spawn((char *[]){"gcc", "-O0", "-w", src, "-o", bin, NULL});
+    running++;
+  }
+  for (; running > 0; running--)
+  {
+    int status;
+    wait(&status);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+
+  // run in order, so that the output is the same for the same seed
+  for (int k = 0; k < nr_chunk; k++)
+  {
+    snprintf(path, sizeof(path), "%s/%d", dir, k);
+    int status;
+    waitpid(spawn((char *[]){path, NULL}), &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%d.c", dir, k);
+    unlink(path);
+  }
+  rmdir(dir);
+}
+
 int main(int argc, char *argv[])
 {
   int seed = time(0);
-  srand(seed);
   int loop = 1;
-  if (argc > 1)
+  int chunk = 0;
+  int o;
+  // gen-expr [-b] [-c CHUNK] [-s SEED] [N]
+  while ((o = getopt(argc, argv, "bc:s:")) != -1)
+  {
+    switch (o)
+    {
+    case 'b':
+      chunk = (chunk == 0 ? 10000 : chunk);
+      break;
+    case 'c':
+      chunk = atoi(optarg);
+      break;
+    case 's':
+      seed = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-b] [-c CHUNK] [-s SEED] [N]\n", argv[0]);
+      return 1;
+    }
+  }
+  srand(seed);
+  if (optind < argc)
+  {
+    sscanf(argv[optind], "%d", &loop);
+  }
+
+  if (chunk > 0)
   {
-    sscanf(argv[1], "%d", &loop);
+    batch(loop, chunk);
+    return 0;
   }
 
   int i;
   for (i = 0; i < loop; i++)
   {
-    buf_pos = 0;
-    buf[0] = '\0';
-
-    gen_rand_expr();
-    buf[buf_pos] = '\0';
+    gen_one();
 
     if (strlen(buf) == 0)
       continue;
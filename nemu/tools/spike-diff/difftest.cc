@@ -77,14 +77,38 @@ void sim_t::diff_memcpy(reg_t dest, void* src, size_t n) {
   }
 }
 
+// the memory is allocated by pages on demand, read them directly
+static void diff_memcpy_to_dut(reg_t src, void* dest, size_t n) {
+  mem_t* mem = difftest_mem[0].second;
+  while (n > 0) {
+    reg_t off = src - DRAM_BASE;
+    size_t len = PGSIZE - off % PGSIZE;
+    if (len > n) len = n;
+    memcpy(dest, mem->contents(off), len);
+    src += len;
+    dest = (uint8_t*)dest + len;
+    n -= len;
+  }
+}
+
 extern "C" {
 
 __EXPORT void difftest_memcpy(paddr_t addr, void *buf, size_t n, bool direction) {
   if (direction == DIFFTEST_TO_REF) {
     s->diff_memcpy(addr, buf, n);
   } else {
-    assert(0);
+    diff_memcpy_to_dut(addr, buf, n);
+  }
+}
+
+__EXPORT uint64_t difftest_memhash(paddr_t addr, size_t n) {
+  reg_t off = addr - DRAM_BASE;
+  if (off % PGSIZE + n <= PGSIZE) {
+    return difftest_hash(difftest_mem[0].second->contents(off), n);
   }
+  std::vector<uint8_t> buf(n);
+  diff_memcpy_to_dut(addr, buf.data(), n);
+  return difftest_hash(buf.data(), n);
 }
 
 __EXPORT void difftest_regcpy(void* dut, bool direction) {